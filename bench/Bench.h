@@ -0,0 +1,68 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+// keep the compiler from optimizing away a value that is computed but never used
+template <typename T>
+inline void doNotOptimize(T const& value) {
+	asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/**
+ * run func repeatedly for at least minDuration and print the time per call
+ * bytes is the amount of data one call processes, it is used to print the throughput
+ */
+template <typename Func>
+void measure(std::string const& name, std::size_t bytes, Func&& func, std::chrono::milliseconds minDuration = std::chrono::milliseconds{200}) {
+	using Clock = std::chrono::steady_clock;
+	// warm up caches and branch predictors
+	for (int i{0}; i < 100; ++i) {
+		func();
+	}
+	int64_t iterations {0};
+	int64_t batch {64};
+	auto start = Clock::now();
+	auto elapsed = Clock::duration{0};
+	while (elapsed < minDuration) {
+		for (int64_t i{0}; i < batch; ++i) {
+			func();
+		}
+		iterations += batch;
+		batch *= 2;
+		elapsed = Clock::now() - start;
+	}
+	double ns = std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+	std::cout << "  " << std::left << std::setw(48) << name << std::right << std::fixed << std::setprecision(1)
+	          << std::setw(12) << ns << " ns/op";
+	if (bytes > 0) {
+		std::cout << std::setw(12) << bytes / ns * 1e3 << " MB/s";
+	}
+	std::cout << "\n";
+}
+
+struct Suite {
+	std::string name;
+	std::function<void()> run;
+};
+
+inline auto getSuites() -> std::vector<Suite>& {
+	static std::vector<Suite> suites;
+	return suites;
+}
+
+// register a suite of benchmarks, meant to be used as a global variable in the file that defines the suite
+struct RegisterSuite {
+	RegisterSuite(std::string const& name, std::function<void()> run) {
+		getSuites().push_back({name, std::move(run)});
+	}
+};
+
+}
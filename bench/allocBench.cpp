@@ -0,0 +1,113 @@
+#include "Bench.h"
+
+#include <usb2dynamixel/BusSimulator.h>
+#include <usb2dynamixel/USB2Dynamixel.h>
+
+#include <cstdlib>
+#include <new>
+#include <stdexcept>
+
+// every allocation of the calling thread is counted, the simulator thread does not disturb the numbers
+namespace {
+thread_local int64_t allocations {0};
+}
+
+void* operator new(std::size_t size) {
+	++allocations;
+	if (auto ptr = std::malloc(size == 0 ? 1 : size)) {
+		return ptr;
+	}
+	throw std::bad_alloc{};
+}
+
+void operator delete(void* ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+	std::free(ptr);
+}
+
+namespace {
+
+using namespace dynamixel;
+
+template <typename Func>
+auto countAllocations(Func&& func) -> int64_t {
+	auto before = allocations;
+	func();
+	return allocations - before;
+}
+
+/**
+ * a read/write cycle on a simulated bus: a typed read of one motor, a prepared read of the full layout
+ * of all motors into an array of layouts and a prepared sync write. None of it may allocate.
+ */
+template <typename FullLayout>
+void benchCycle(Protocol protocol, LayoutType layout, int goalRegister) {
+	constexpr int numMotors = 4;
+	auto name = std::string{"v"} + std::to_string(int(protocol));
+
+	BusSimulator simulator{{protocol, {}, {}, 0., 0}};
+	simulator.addMotors(layout, numMotors, 1);
+	simulator.start();
+	USB2Dynamixel usb2dyn{1000000, simulator.getDevicePath(), protocol};
+	auto timeout = USB2Dynamixel::Timeout{20000};
+
+	std::vector<MotorID> motors;
+	std::vector<std::tuple<MotorID, int, std::size_t>> request;
+	for (MotorID id{1}; id <= numMotors; ++id) {
+		motors.push_back(id);
+		request.emplace_back(id, int(FullLayout::BaseRegister), sizeof(FullLayout));
+	}
+	auto prepared = usb2dyn.supportsSyncRead()
+		? usb2dyn.prepareSyncRead(motors, int(FullLayout::BaseRegister), sizeof(FullLayout))
+		: usb2dyn.prepareBulkRead(request);
+	auto layouts = std::vector<FullLayout>(numMotors);
+	auto single  = FullLayout{};
+	auto write   = usb2dyn.prepareSyncWrite(motors, goalRegister, 2);
+
+	std::size_t missing {0};
+	uint16_t goal {0};
+	auto cycle = [&] {
+		auto [timeoutFlag, motorID, errorCode] = usb2dyn.read(1, single, timeout);
+		missing += timeoutFlag ? 1 : 0;
+		missing += numMotors - usb2dyn.execute(prepared, layouts.data(), timeout);
+		++goal;
+		for (std::size_t idx{0}; idx < motors.size(); ++idx) {
+			write.set(idx, ByteSpan{reinterpret_cast<std::byte const*>(&goal), sizeof(goal)});
+		}
+		usb2dyn.sync_write(write);
+	};
+
+	// warm up, buffers of the port and the timing model reach their final size
+	for (int i{0}; i < 10; ++i) {
+		cycle();
+	}
+	missing = 0;
+	auto numAllocations = countAllocations([&] {
+		for (int i{0}; i < 1000; ++i) {
+			cycle();
+		}
+	});
+	if (missing > 0) {
+		throw std::runtime_error(name + ": " + std::to_string(missing) + " replies are missing");
+	}
+	if (numAllocations != 0) {
+		throw std::runtime_error(name + ": a read/write cycle allocated " + std::to_string(numAllocations / 1000.) + " times");
+	}
+	auto legacyAllocations = countAllocations([&] {
+		bench::doNotOptimize(usb2dyn.bulk_read(request, timeout));
+	});
+	std::cout << "  " << name << ": 1000 cycles without allocation (the vector based bulk_read allocates " << legacyAllocations << " times)\n";
+
+	bench::measure(name + " read/write cycle on a pty (" + std::to_string(numMotors) + " motors)", 0, cycle);
+	simulator.stop();
+}
+
+auto allocSuite = bench::RegisterSuite{"alloc", [] {
+	benchCycle<mx_v1::FullLayout>(Protocol::V1, LayoutType::MX_V1, int(mx_v1::Register::GOAL_POSITION));
+	benchCycle<mx_v2::FullLayout>(Protocol::V2, LayoutType::MX_V2, int(mx_v2::Register::GOAL_POSITION));
+}};
+
+}
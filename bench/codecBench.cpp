@@ -0,0 +1,249 @@
+#include "Bench.h"
+
+#include <usb2dynamixel/Crc16.h>
+#include <usb2dynamixel/ProtocolV1.h>
+#include <usb2dynamixel/ProtocolV2.h>
+#include <usb2dynamixel/RxBuffer.h>
+#include <usb2dynamixel/LayoutMX_V1.h>
+#include <usb2dynamixel/LayoutMX_V2.h>
+#include <usb2dynamixel/LayoutPro.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <map>
+#include <random>
+#include <stdexcept>
+
+namespace {
+
+using namespace dynamixel;
+
+// random payload, every 32nd byte starts a sequence that has to be escaped in protocol v2
+auto makePayload(std::size_t size) -> Parameter {
+	std::mt19937 rng{size};
+	Parameter payload(size);
+	for (auto& b : payload) {
+		b = std::byte(rng());
+	}
+	for (std::size_t i{0}; i + 3 <= size; i += 32) {
+		payload[i]   = std::byte{0xff};
+		payload[i+1] = std::byte{0xff};
+		payload[i+2] = std::byte{0xfd};
+	}
+	return payload;
+}
+
+auto const payloadSizes = std::vector<std::size_t>{2, 16, 64, 147, 253, 1024};
+
+// byte by byte reference of the protocol v2 byte stuffing, the way it was done before the codec worked on spans
+auto referenceEscapes(Parameter const& data) -> Parameter {
+	Parameter escaped;
+	for (std::size_t i{0}; i < data.size(); ++i) {
+		escaped.emplace_back(data[i]);
+		if (i >= 2 and data[i] == std::byte{0xfd} and data[i-1] == std::byte{0xff} and data[i-2] == std::byte{0xff}) {
+			escaped.emplace_back(std::byte{0xfd});
+		}
+	}
+	return escaped;
+}
+
+auto referencePacket(MotorID motorID, Instruction instr, Parameter const& data) -> Parameter {
+	auto escaped = referenceEscapes(data);
+	Parameter txBuf {std::byte{0xff}, std::byte{0xff}, std::byte{0xfd}, std::byte{0x00}, std::byte(motorID),
+		std::byte((escaped.size() + 3) & 0xff), std::byte(((escaped.size() + 3) >> 8) & 0xff), std::byte(instr)};
+	txBuf.insert(txBuf.end(), escaped.begin(), escaped.end());
+	auto checkSum = crc16::compute(crc16::Engine::Bytewise, txBuf.data(), txBuf.size());
+	txBuf.push_back(std::byte(checkSum & 0xff));
+	txBuf.push_back(std::byte((checkSum >> 8) & 0xff));
+	return txBuf;
+}
+
+// the span based codec has to produce exactly the packets of the reference and has to undo its own stuffing
+void validateV2() {
+	ProtocolV2 protocol;
+	std::mt19937 rng{0};
+	auto const alphabet = std::array<std::byte, 4>{std::byte{0xff}, std::byte{0xfd}, std::byte{0x00}, std::byte{0x42}};
+	Parameter txBuf;
+	for (int i{0}; i < 20000; ++i) {
+		// few distinct values make escape sequences frequent and let them overlap
+		Parameter data(rng() % 300);
+		for (auto& b : data) {
+			b = alphabet[rng() % alphabet.size()];
+		}
+		ProtocolV2::encodePacket(txBuf, 1, Instruction::WRITE, ByteSpan{data.data(), data.size()});
+		if (txBuf != referencePacket(1, Instruction::WRITE, data)) {
+			throw std::runtime_error("encodePacket differs from the reference for " + std::to_string(data.size()) + " bytes");
+		}
+		auto escaped = referenceEscapes(data);
+
+		// the same parameters given as two pieces with a random split point
+		auto split = data.empty() ? 0 : rng() % data.size();
+		auto pieces = std::array<ByteSpan, 2>{ByteSpan{data.data(), split}, ByteSpan{data.data() + split, data.size() - split}};
+		ProtocolBase::PacketFrame frame;
+		if (protocol.framePacket(1, Instruction::WRITE, pieces.data(), pieces.size(), frame)) {
+			Parameter framed(frame.header.begin(), frame.header.begin() + frame.headerSize);
+			framed.insert(framed.end(), data.begin(), data.end());
+			framed.insert(framed.end(), frame.trailer.begin(), frame.trailer.begin() + frame.trailerSize);
+			if (framed != txBuf) {
+				throw std::runtime_error("framePacket differs from encodePacket for " + std::to_string(data.size()) + " bytes");
+			}
+		} else if (escaped.size() == data.size()) {
+			throw std::runtime_error("framePacket rejected " + std::to_string(data.size()) + " bytes that need no byte stuffing");
+		}
+
+		auto end = ProtocolV2::removeEscapes(escaped.data(), escaped.data() + escaped.size());
+		if (not std::equal(escaped.data(), end, data.begin(), data.end())) {
+			throw std::runtime_error("removeEscapes does not restore " + std::to_string(data.size()) + " bytes");
+		}
+	}
+	std::cout << "  validated byte stuffing of 20000 packets\n";
+}
+
+void benchV2() {
+	validateV2();
+	ProtocolV2 protocol;
+	RxBuffer rxBuffer;
+	Parameter txBuf;
+	for (auto size : payloadSizes) {
+		auto payload = makePayload(size);
+		auto packet  = protocol.createPacket(1, Instruction::WRITE, payload);
+		auto escaped = referenceEscapes(payload);
+		auto suffix  = " (" + std::to_string(size) + " bytes)";
+
+		bench::measure("v2 reference packet" + suffix, packet.size(), [&] {
+			bench::doNotOptimize(referencePacket(1, Instruction::WRITE, payload));
+		});
+		bench::measure("v2 createPacket" + suffix, packet.size(), [&] {
+			bench::doNotOptimize(protocol.createPacket(1, Instruction::WRITE, payload));
+		});
+		bench::measure("v2 encodePacket (reused buffer)" + suffix, packet.size(), [&] {
+			ProtocolV2::encodePacket(txBuf, 1, Instruction::WRITE, ByteSpan{payload.data(), payload.size()});
+			bench::doNotOptimize(txBuf.data());
+		});
+		bench::measure("v2 reference escapes" + suffix, payload.size(), [&] {
+			bench::doNotOptimize(referenceEscapes(payload));
+		});
+		bench::measure("v2 appendEscaped (reused buffer)" + suffix, payload.size(), [&] {
+			uint16_t crc {0};
+			txBuf.clear();
+			bench::doNotOptimize(ProtocolV2::appendEscaped(txBuf, ByteSpan{payload.data(), payload.size()}, crc));
+			bench::doNotOptimize(crc);
+		});
+		auto scratch = escaped;
+		bench::measure("v2 removeEscapes" + suffix, escaped.size(), [&] {
+			std::copy(escaped.begin(), escaped.end(), scratch.begin());
+			bench::doNotOptimize(ProtocolV2::removeEscapes(scratch.data(), scratch.data() + scratch.size()));
+		});
+		bench::measure("v2 calculateChecksum" + suffix, packet.size(), [&] {
+			bench::doNotOptimize(ProtocolV2::calculateChecksum(packet.data(), packet.data() + packet.size()));
+		});
+		bench::measure("v2 decodePacket" + suffix, packet.size(), [&] {
+			rxBuffer.append(packet.data(), packet.size());
+			bench::doNotOptimize(protocol.decodePacket(rxBuffer));
+		});
+	}
+}
+
+void benchV1() {
+	ProtocolV1 protocol;
+	RxBuffer rxBuffer;
+	for (auto size : payloadSizes) {
+		if (size > 253) {
+			continue;
+		}
+		auto payload = makePayload(size);
+		auto packet  = protocol.createPacket(1, Instruction::WRITE, payload);
+		auto suffix  = " (" + std::to_string(size) + " bytes)";
+
+		bench::measure("v1 createPacket" + suffix, packet.size(), [&] {
+			bench::doNotOptimize(protocol.createPacket(1, Instruction::WRITE, payload));
+		});
+		bench::measure("v1 calculateChecksum" + suffix, packet.size(), [&] {
+			bench::doNotOptimize(ProtocolV1::calculateChecksum(packet));
+		});
+		bench::measure("v1 validateChecksum" + suffix, packet.size(), [&] {
+			bench::doNotOptimize(ProtocolV1::validateChecksum(packet.data(), packet.size()));
+		});
+		bench::measure("v1 decodePacket" + suffix, packet.size(), [&] {
+			rxBuffer.append(packet.data(), packet.size());
+			bench::doNotOptimize(protocol.decodePacket(rxBuffer));
+		});
+	}
+}
+
+void benchBulkRead() {
+	ProtocolV1 v1;
+	ProtocolV2 v2;
+	for (std::size_t numMotors : {1, 6, 24, 64}) {
+		std::vector<std::tuple<MotorID, int, size_t>> motors;
+		for (std::size_t i{0}; i < numMotors; ++i) {
+			motors.emplace_back(MotorID(i), 36, 8);
+		}
+		auto suffix = " (" + std::to_string(numMotors) + " motors)";
+		bench::measure("v1 buildBulkReadPackage" + suffix, 0, [&] {
+			bench::doNotOptimize(v1.buildBulkReadPackage(motors));
+		});
+		bench::measure("v2 buildBulkReadPackage" + suffix, 0, [&] {
+			bench::doNotOptimize(v2.buildBulkReadPackage(motors));
+		});
+	}
+}
+
+// a sync write of a goal position (4 bytes) to 20 motors, built from scratch versus patching a prepared packet
+void benchSyncWrite(ProtocolBase const& protocol, std::string const& name) {
+	constexpr std::size_t numMotors = 20;
+	constexpr std::size_t length    = 4;
+	std::array<std::byte, 4> prefix;
+	auto prefixSize = protocol.writeAddress(116, prefix.data());
+	prefixSize += protocol.writeLength(length, prefix.data() + prefixSize);
+
+	std::map<MotorID, Parameter> motorParams;
+	for (std::size_t i{0}; i < numMotors; ++i) {
+		motorParams[MotorID(i + 1)] = Parameter(length, std::byte(i));
+	}
+	auto build = [&] {
+		Parameter txBuf(prefix.begin(), prefix.begin() + prefixSize);
+		for (auto const& [id, params] : motorParams) {
+			txBuf.push_back(std::byte{id});
+			txBuf.insert(txBuf.end(), params.begin(), params.end());
+		}
+		return protocol.createPacket(BroadcastID, Instruction::SYNC_WRITE, txBuf);
+	};
+	auto packet = build();
+	bench::measure(name + " sync_write build packet (20 motors)", packet.size(), [&] {
+		bench::doNotOptimize(build());
+	});
+	auto dataOffset = protocol.parameterOffset() + prefixSize;
+	bench::measure(name + " sync_write patch prepared packet (20 motors)", packet.size(), [&] {
+		std::size_t i{0};
+		for (auto const& [id, params] : motorParams) {
+			std::memcpy(packet.data() + dataOffset + i++ * (length + 1) + 1, params.data(), length);
+		}
+		bench::doNotOptimize(protocol.updateChecksum(packet));
+	});
+	if (packet != build()) {
+		throw std::runtime_error(name + " prepared sync write packet differs from a freshly built one");
+	}
+}
+
+template <typename Layout>
+void benchLayout(std::string const& name) {
+	auto buffer = makePayload(sizeof(Layout));
+	bench::measure("Layout from vector " + name + " (" + std::to_string(sizeof(Layout)) + " bytes)", sizeof(Layout), [&] {
+		bench::doNotOptimize(Layout{buffer});
+	});
+}
+
+auto codecSuite = bench::RegisterSuite{"codec", [] {
+	benchV2();
+	benchV1();
+	benchBulkRead();
+	benchSyncWrite(ProtocolV1{}, "v1");
+	benchSyncWrite(ProtocolV2{}, "v2");
+	benchLayout<mx_v1::FullLayout>("mx_v1::FullLayout");
+	benchLayout<mx_v2::FullLayout>("mx_v2::FullLayout");
+	benchLayout<pro::FullLayout>("pro::FullLayout");
+}};
+
+}
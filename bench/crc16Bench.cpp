@@ -0,0 +1,60 @@
+#include "Bench.h"
+
+#include <usb2dynamixel/Crc16.h>
+
+#include <random>
+#include <stdexcept>
+
+namespace {
+
+using namespace dynamixel;
+
+auto const engines = std::vector<crc16::Engine>{crc16::Engine::Bytewise, crc16::Engine::Slice8, crc16::Engine::Clmul};
+
+// every engine has to produce exactly the checksum of the bytewise engine, for any length, alignment and start value
+void validate() {
+	std::mt19937 rng{0};
+	std::vector<std::byte> data(4096 + 16);
+	for (auto& b : data) {
+		b = std::byte(rng());
+	}
+	int checks {0};
+	for (int i{0}; i < 20000; ++i) {
+		auto size   = i < 2048 ? std::size_t(i) : std::size_t(rng() % 4096);
+		auto offset = std::size_t(rng() % 16);
+		auto crc    = uint16_t(rng());
+		auto expected = crc16::compute(crc16::Engine::Bytewise, data.data() + offset, size, crc);
+		for (auto engine : engines) {
+			if (not crc16::isSupported(engine)) {
+				continue;
+			}
+			auto actual = crc16::compute(engine, data.data() + offset, size, crc);
+			if (actual != expected) {
+				throw std::runtime_error(std::string{"crc16 engine "} + crc16::to_string(engine) + " computed a wrong checksum for " + std::to_string(size) + " bytes");
+			}
+			++checks;
+		}
+	}
+	std::cout << "  validated " << checks << " checksums, compute() uses " << crc16::to_string(crc16::getEngine()) << "\n";
+}
+
+auto crc16Suite = bench::RegisterSuite{"crc16", [] {
+	validate();
+	std::mt19937 rng{1};
+	for (std::size_t size : {8, 16, 64, 147, 256, 904, 4096}) {
+		std::vector<std::byte> data(size);
+		for (auto& b : data) {
+			b = std::byte(rng());
+		}
+		for (auto engine : engines) {
+			if (not crc16::isSupported(engine)) {
+				continue;
+			}
+			bench::measure(std::string{"crc16 "} + crc16::to_string(engine) + " (" + std::to_string(size) + " bytes)", size, [&] {
+				bench::doNotOptimize(crc16::compute(engine, data.data(), data.size()));
+			});
+		}
+	}
+}};
+
+}
@@ -0,0 +1,77 @@
+#include "Bench.h"
+
+#include <usb2dynamixel/BusSimulator.h>
+#include <usb2dynamixel/IndirectMapping.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+using namespace dynamixel;
+
+// protocol v2 status packet: header (4), id, length (2), instruction, error, crc (2)
+constexpr std::size_t statusOverhead = 11;
+
+/**
+ * map position, current and hardware error status into the indirect data block, the values read through it have to
+ * match a full layout read. Both reads are timed on a simulated bus.
+ */
+template <typename FullLayout, typename Register>
+void benchIndirect(LayoutType layout) {
+	constexpr int numMotors = 4;
+	auto name = to_string(layout);
+
+	BusSimulator simulator{{Protocol::V2, {}, {}, 0., 0}};
+	simulator.addMotors(layout, numMotors, 1);
+	simulator.start();
+	USB2Dynamixel usb2dyn{1000000, simulator.getDevicePath(), Protocol::V2};
+	auto timeout = USB2Dynamixel::Timeout{20000};
+
+	std::vector<MotorID> motors;
+	for (MotorID id{1}; id <= numMotors; ++id) {
+		motors.push_back(id);
+	}
+	auto mapping = buildIndirectMapping(layout, {int(Register::PRESENT_POSITION), int(Register::PRESENT_CURRENT), int(Register::HARDWARE_ERROR_STATUS)});
+	programIndirectMapping(usb2dyn, motors, mapping);
+	// a value that differs from the defaults, the data block must follow the register
+	usb2dyn.write(2, int(Register::PRESENT_POSITION), Parameter{std::byte{0x34}, std::byte{0x12}, std::byte{0}, std::byte{0}});
+
+	auto indirect = prepareIndirectRead(usb2dyn, motors, mapping);
+	auto full     = usb2dyn.prepareSyncRead(motors, int(FullLayout::BaseRegister), sizeof(FullLayout));
+	auto layouts  = std::vector<FullLayout>(numMotors);
+	if (usb2dyn.execute(indirect, timeout) != numMotors or usb2dyn.execute(full, layouts.data(), timeout) != numMotors) {
+		throw std::runtime_error(name + ": replies are missing");
+	}
+	for (std::size_t idx{0}; idx < motors.size(); ++idx) {
+		auto data = indirect.getData(idx);
+		auto raw  = reinterpret_cast<std::byte const*>(&layouts[idx]);
+		for (auto const& [reg, length, offset] : mapping.registers) {
+			if (not std::equal(data.begin() + offset, data.begin() + offset + length, raw + reg)) {
+				throw std::runtime_error(name + ": indirect register " + std::to_string(reg) + " of motor " + std::to_string(int(motors[idx])) + " differs from the full layout");
+			}
+		}
+	}
+	if (layouts[1].present_position != 0x1234) {
+		throw std::runtime_error(name + ": write did not reach the present position");
+	}
+
+	auto indirectBytes = indirect.packet.size() + numMotors * (statusOverhead + mapping.length);
+	auto fullBytes     = full.packet.size() + numMotors * (statusOverhead + sizeof(FullLayout));
+	std::cout << "  " << name << ": " << indirectBytes << " bytes on the wire per cycle through the indirect block, " << fullBytes << " for the full layout\n";
+
+	bench::measure(name + " sync read indirect block (" + std::to_string(numMotors) + " motors)", indirectBytes, [&] {
+		usb2dyn.execute(indirect, timeout);
+	});
+	bench::measure(name + " sync read full layout (" + std::to_string(numMotors) + " motors)", fullBytes, [&] {
+		usb2dyn.execute(full, layouts.data(), timeout);
+	});
+	simulator.stop();
+}
+
+auto indirectSuite = bench::RegisterSuite{"indirect", [] {
+	benchIndirect<mx_v2::FullLayout, mx_v2::Register>(LayoutType::MX_V2);
+	benchIndirect<pro::FullLayout, pro::Register>(LayoutType::Pro);
+}};
+
+}
@@ -0,0 +1,19 @@
+#include "Bench.h"
+
+#include <cstring>
+
+// run all suites or only those whose name contains one of the arguments
+int main(int argc, char** argv) {
+	for (auto const& suite : bench::getSuites()) {
+		bool selected = argc < 2;
+		for (int i{1}; i < argc; ++i) {
+			selected |= suite.name.find(argv[i]) != std::string::npos;
+		}
+		if (not selected) {
+			continue;
+		}
+		std::cout << suite.name << "\n";
+		suite.run();
+	}
+	return 0;
+}
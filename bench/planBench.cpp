@@ -0,0 +1,95 @@
+#include "Bench.h"
+
+#include <usb2dynamixel/ReadPlanner.h>
+#include <usb2dynamixel/Layout.h>
+
+#include <random>
+#include <stdexcept>
+
+namespace {
+
+using namespace dynamixel;
+
+// the cheapest partition of sorted, disjoint registers into windows by trying all 2^(n-1) of them
+auto bruteForce(ReadCostModel const& model, std::size_t numMotors, std::vector<std::tuple<int, std::size_t>> const& registers) -> std::chrono::nanoseconds {
+	auto best = std::chrono::nanoseconds::max();
+	auto n = registers.size();
+	for (uint32_t splits{0}; splits < (1u << (n - 1)); ++splits) {
+		auto time = std::chrono::nanoseconds{0};
+		std::size_t first{0};
+		bool valid {true};
+		for (std::size_t i{0}; i < n; ++i) {
+			if (i + 1 < n and not (splits & (1u << i))) {
+				continue;
+			}
+			auto length = std::size_t(std::get<0>(registers[i]) + int(std::get<1>(registers[i])) - std::get<0>(registers[first]));
+			valid = valid and length <= model.maxLength();
+			time += model.estimate(numMotors, length);
+			first = i + 1;
+		}
+		if (valid) {
+			best = std::min(best, time);
+		}
+	}
+	return best;
+}
+
+// the planned windows have to cover every register and cost as little as the best partition
+void validate() {
+	std::mt19937 rng{0};
+	int checks {0};
+	for (int i{0}; i < 2000; ++i) {
+		ReadCostModel model;
+		model.protocol = rng() % 2 ? Protocol::V1 : Protocol::V2;
+		model.syncRead = model.protocol == Protocol::V2 and rng() % 2;
+		model.baudrate = 1000000;
+		model.overhead = std::chrono::microseconds{rng() % 600};
+		auto numMotors = 1 + rng() % 16;
+		std::vector<MotorID> motors(numMotors, 1);
+
+		std::vector<std::tuple<int, std::size_t>> registers;
+		int reg = rng() % 8;
+		for (std::size_t n{0}, count{1 + rng() % 12}; n < count; ++n) {
+			auto length = std::size_t(1) << (rng() % 3);
+			registers.emplace_back(reg, length);
+			reg += int(length) + int(rng() % 120);
+		}
+		auto plan = planRead(model, motors, registers);
+		for (auto const& [r, length] : registers) {
+			auto location = plan.locate(r);
+			if (not location or std::get<1>(*location) + length > std::get<1>(plan.windows[std::get<0>(*location)])) {
+				throw std::runtime_error("read plan does not cover register " + std::to_string(r));
+			}
+		}
+		if (plan.estimatedTime != bruteForce(model, numMotors, registers)) {
+			throw std::runtime_error("read plan is not the cheapest for " + std::to_string(registers.size()) + " registers");
+		}
+		++checks;
+	}
+	std::cout << "  validated " << checks << " read plans against all partitions\n";
+}
+
+auto planSuite = bench::RegisterSuite{"plan", [] {
+	validate();
+	ReadCostModel model;
+	model.protocol = Protocol::V2;
+	model.syncRead = true;
+	model.overhead = std::chrono::microseconds{100};
+	std::vector<MotorID> motors {1, 2, 3, 4, 5, 6};
+	std::vector<std::tuple<int, std::size_t>> all;
+	for (auto const& [reg, field] : pro::MotorLayoutInfo::getInfos()) {
+		all.emplace_back(int(reg), field.length);
+	}
+	auto telemetry = std::vector<std::tuple<int, std::size_t>>{{int(pro::Register::PRESENT_POSITION), 4}, {int(pro::Register::PRESENT_CURRENT), 2}, {int(pro::Register::HARDWARE_ERROR_STATUS), 1}};
+	auto plan = planRead(model, motors, telemetry);
+	std::cout << "  pro telemetry: " << plan.windows.size() << " windows, " << plan.wireBytes << " bytes instead of "
+	          << model.requestBytes(motors.size()) + model.replyBytes(motors.size(), pro::FullLayout::Length) << " for the full layout\n";
+	bench::measure("planRead pro telemetry (3 registers)", 0, [&] {
+		bench::doNotOptimize(planRead(model, motors, telemetry));
+	});
+	bench::measure("planRead pro all registers (" + std::to_string(all.size()) + " registers)", 0, [&] {
+		bench::doNotOptimize(planRead(model, motors, all));
+	});
+}};
+
+}
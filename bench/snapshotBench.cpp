@@ -0,0 +1,135 @@
+#include "Bench.h"
+
+#include <usb2dynamixel/BusSimulator.h>
+#include <usb2dynamixel/MotorMetaInfo.h>
+#include <usb2dynamixel/SnapshotCache.h>
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+using namespace dynamixel;
+
+/**
+ * every readable register of 20 motors is read once, as a `grep .` over all by-register-id files of the fuse tree does.
+ * Register by register reads are compared with reads served from the snapshot cache.
+ * Then several threads (dashboards on the fuse mount) keep reading at once and share the refreshes of the cache.
+ */
+template <typename Info>
+void benchSnapshots(Protocol protocol) {
+	constexpr int numMotors = 20;
+	auto name = to_string(Info::Type);
+
+	BusSimulator simulator{{protocol, {}, {}, 0., 0}};
+	simulator.addMotors(Info::Type, numMotors, 1);
+	simulator.start();
+	USB2Dynamixel usb2dyn{1000000, simulator.getDevicePath(), protocol};
+	auto timeout = USB2Dynamixel::Timeout{20000};
+
+	std::vector<std::tuple<int, std::size_t>> registers;
+	for (auto const& [reg, field] : Info::getInfos()) {
+		if ((int(field.access) & int(meta::LayoutField::Access::R)) and reg < Info::FullLayout::BaseRegister + Info::FullLayout::Length) {
+			registers.emplace_back(int(reg), field.length);
+		}
+	}
+	SnapshotCache cache{usb2dyn, std::chrono::seconds{10}};
+	for (MotorID id{1}; id <= numMotors; ++id) {
+		cache.addMotor(id, Info::Type, registers);
+	}
+
+	auto packetsBefore = simulator.getStats().packets;
+	auto direct = std::vector<Parameter>{};
+	for (MotorID id{1}; id <= numMotors; ++id) {
+		for (auto const& [reg, length] : registers) {
+			auto [timeoutFlag, motorID, errorCode, data] = usb2dyn.read(id, reg, length, timeout);
+			if (timeoutFlag) {
+				throw std::runtime_error(name + ": motor " + std::to_string(int(id)) + " did not reply");
+			}
+			direct.push_back(data);
+		}
+	}
+	auto directPackets = simulator.getStats().packets - packetsBefore;
+
+	packetsBefore = simulator.getStats().packets;
+	std::size_t i{0};
+	for (MotorID id{1}; id <= numMotors; ++id) {
+		for (auto const& [reg, length] : registers) {
+			Parameter data(length);
+			if (not cache.read(id, reg, length, data.data(), timeout) or data != direct[i++]) {
+				throw std::runtime_error(name + ": snapshot of register " + std::to_string(reg) + " of motor " + std::to_string(int(id)) + " differs from a direct read");
+			}
+		}
+	}
+	auto cachePackets = simulator.getStats().packets - packetsBefore;
+	auto stats = cache.getStats();
+	std::cout << "  " << name << ": " << numMotors * registers.size() << " register reads cost " << directPackets << " requests directly and "
+	          << cachePackets << " through the snapshot cache (" << stats.hits << " hits)\n";
+
+	SnapshotCache fresh{usb2dyn, std::chrono::microseconds{0}};
+	for (MotorID id{1}; id <= numMotors; ++id) {
+		fresh.addMotor(id, Info::Type, registers);
+	}
+	bench::measure(name + " refresh snapshots (" + std::to_string(numMotors) + " motors)", 0, [&] {
+		std::byte value;
+		bench::doNotOptimize(fresh.read(1, std::get<0>(registers.front()), 1, &value, timeout));
+	}, std::chrono::milliseconds{500});
+
+	// the whole fleet at once, as /all/snapshot.csv renders it
+	packetsBefore = simulator.getStats().packets;
+	auto tables = fresh.snapshotAll(timeout);
+	auto allPackets = simulator.getStats().packets - packetsBefore;
+	i = 0;
+	for (MotorID id{1}; id <= numMotors; ++id) {
+		for (auto const& [reg, length] : registers) {
+			auto const& table = tables.at(id);
+			if (not std::equal(direct[i].begin(), direct[i].end(), table.begin() + reg)) {
+				throw std::runtime_error(name + ": copied snapshot of register " + std::to_string(reg) + " of motor " + std::to_string(int(id)) + " differs from a direct read");
+			}
+			++i;
+		}
+	}
+	std::cout << "  " << name << ": a copy of all " << tables.size() << " snapshots costs " << allPackets << " requests\n";
+
+	constexpr int numReaders     = 4;
+	constexpr int readsPerReader = 50;
+	SnapshotCache shared{usb2dyn, std::chrono::microseconds{0}};
+	for (MotorID id{1}; id <= numMotors; ++id) {
+		shared.addMotor(id, Info::Type, registers);
+	}
+	packetsBefore = simulator.getStats().packets;
+	std::atomic<bool> mismatch {false};
+	std::vector<std::thread> readers;
+	for (int r{0}; r < numReaders; ++r) {
+		readers.emplace_back([&, r] {
+			auto id = MotorID(r + 1);
+			auto reg    = std::get<0>(registers.front());
+			auto length = std::get<1>(registers.front());
+			for (int i{0}; i < readsPerReader; ++i) {
+				Parameter data(length);
+				if (not shared.read(id, reg, length, data.data(), timeout) or data != direct[r * registers.size()]) {
+					mismatch = true;
+				}
+			}
+		});
+	}
+	for (auto& reader : readers) {
+		reader.join();
+	}
+	if (mismatch) {
+		throw std::runtime_error(name + ": a concurrent read differs from a direct read");
+	}
+	auto sharedStats = shared.getStats();
+	std::cout << "  " << name << ": " << numReaders << " concurrent readers, " << sharedStats.reads << " reads served by "
+	          << sharedStats.batches << " refreshes (" << simulator.getStats().packets - packetsBefore << " requests)\n";
+	simulator.stop();
+}
+
+auto snapshotSuite = bench::RegisterSuite{"snapshot", [] {
+	benchSnapshots<mx_v1::MotorLayoutInfo>(Protocol::V1);
+	benchSnapshots<mx_v2::MotorLayoutInfo>(Protocol::V2);
+}};
+
+}
@@ -0,0 +1,98 @@
+#include "Bench.h"
+
+#include <usb2dynamixel/BusSimulator.h>
+#include <usb2dynamixel/MotorStateTable.h>
+
+#include <array>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+
+namespace {
+
+using namespace dynamixel;
+
+using Table = MotorStateTable<LayoutType::MX_V2, mx_v2::Register::PRESENT_CURRENT, mx_v2::Register::PRESENT_VELOCITY, mx_v2::Register::PRESENT_POSITION>;
+static_assert(Table::BaseRegister == mx_v2::Register::PRESENT_CURRENT and Table::Length == 10);
+
+// the table has to hold exactly what a full layout read of the same motors returns
+void validate() {
+	constexpr int numMotors = 4;
+	BusSimulator simulator{{Protocol::V2, {}, {}, 0., 0}};
+	simulator.addMotors(LayoutType::MX_V2, numMotors, 1);
+	simulator.start();
+	USB2Dynamixel usb2dyn{1000000, simulator.getDevicePath(), Protocol::V2};
+	auto timeout = USB2Dynamixel::Timeout{20000};
+
+	std::vector<MotorID> motors;
+	for (MotorID id{1}; id <= numMotors; ++id) {
+		motors.push_back(id);
+	}
+	// motor 5 does not exist and has to stay invalid
+	motors.push_back(numMotors + 1);
+	Table table{motors};
+	auto read = table.prepareRead(usb2dyn);
+	usb2dyn.execute(read, timeout);
+	table.update(read);
+
+	for (std::size_t row{0}; row < motors.size(); ++row) {
+		auto [timeoutFlag, motorID, errorCode, layout] = usb2dyn.read<mx_v2::Register::MODEL_NUMBER, 147>(motors[row], timeout);
+		if (timeoutFlag == bool(table.getValid()[row])) {
+			throw std::runtime_error("valid flag of motor " + std::to_string(int(motors[row])) + " is wrong");
+		}
+		if (timeoutFlag) {
+			continue;
+		}
+		if (table.column<mx_v2::Register::PRESENT_CURRENT>()[row] != layout.present_current
+		    or table.column<mx_v2::Register::PRESENT_VELOCITY>()[row] != layout.present_velocity
+		    or table.column<mx_v2::Register::PRESENT_POSITION>()[row] != layout.present_position) {
+			throw std::runtime_error("table row of motor " + std::to_string(int(motors[row])) + " differs from the full layout");
+		}
+	}
+	simulator.stop();
+	std::cout << "  validated table against full layout reads\n";
+}
+
+// summing up all present positions, columns of the table versus the response list of bulk_read<FullLayout>
+void benchScan(std::size_t numMotors) {
+	std::mt19937 rng{0};
+	std::vector<MotorID> motors(numMotors);
+	std::iota(motors.begin(), motors.end(), MotorID{0});
+	Table table{motors};
+	std::vector<std::tuple<MotorID, ErrorCode, mx_v2::FullLayout>> responses;
+	for (std::size_t row{0}; row < numMotors; ++row) {
+		mx_v2::FullLayout layout;
+		for (auto& b : reinterpret_cast<std::array<std::byte, sizeof(layout)>&>(layout)) {
+			b = std::byte(rng());
+		}
+		auto raw = reinterpret_cast<std::byte const*>(&layout) + int(Table::BaseRegister);
+		table.update(row, ByteSpan{raw, Table::Length});
+		responses.emplace_back(motors[row], ErrorCode{}, layout);
+	}
+	auto suffix = " (" + std::to_string(numMotors) + " motors)";
+	int64_t expected {0};
+	bench::measure("sum positions of bulk_read response" + suffix, 0, [&] {
+		int64_t sum {0};
+		for (auto const& [id, errorCode, layout] : responses) {
+			sum += layout.present_position;
+		}
+		bench::doNotOptimize(expected = sum);
+	});
+	bench::measure("sum positions of state table column" + suffix, 0, [&] {
+		auto const& positions = table.column<mx_v2::Register::PRESENT_POSITION>();
+		auto sum = std::accumulate(positions.begin(), positions.end(), int64_t{0});
+		if (sum != expected) {
+			throw std::runtime_error("state table sums up to a different value");
+		}
+		bench::doNotOptimize(sum);
+	});
+}
+
+auto stateTableSuite = bench::RegisterSuite{"table", [] {
+	validate();
+	for (std::size_t numMotors : {16, 64, 253}) {
+		benchScan(numMotors);
+	}
+}};
+
+}
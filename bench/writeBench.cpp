@@ -0,0 +1,106 @@
+#include "Bench.h"
+
+#include <usb2dynamixel/BusSimulator.h>
+#include <usb2dynamixel/MotorMetaInfo.h>
+#include <usb2dynamixel/WriteCoalescer.h>
+
+#include <functional>
+#include <stdexcept>
+
+namespace {
+
+using namespace dynamixel;
+
+/**
+ * a script sets Goal Position of 18 motors, then Goal Position and LED of every motor and then Goal Position of the odd
+ * and LED of the even motors. One write per register and motor is compared with the writes coalesced into sync writes
+ * and bulk writes. The values are read back to make sure every motor got its own value.
+ */
+template <typename Info>
+void benchWrites(Protocol protocol) {
+	constexpr int numMotors = 18;
+	using Register = typename std::decay_t<decltype(Info::getInfos())>::key_type;
+	auto name = to_string(Info::Type);
+
+	BusSimulator simulator{{protocol, {}, {}, 0., 0}};
+	simulator.addMotors(Info::Type, numMotors, 1);
+	simulator.start();
+	USB2Dynamixel usb2dyn{1000000, simulator.getDevicePath(), protocol};
+	auto timeout = USB2Dynamixel::Timeout{20000};
+
+	auto goalPosition = int(Register::GOAL_POSITION);
+	auto led          = int(Register::LED);
+	auto const& infos = Info::getInfos();
+	auto encode = [](int value, std::size_t length) {
+		Parameter data(length);
+		for (std::size_t i{0}; i < length; ++i) {
+			data[i] = std::byte(value >> (8 * i));
+		}
+		return data;
+	};
+	// the data written to reg of motor id, every round writes other values
+	auto dataOf = [&](int reg, MotorID id, int round) {
+		auto length = infos.at(Register(reg)).length;
+		return reg == led ? encode(round % 2, length) : encode(1000 + 10 * id + round, length);
+	};
+
+	// reads back the registers, the simulator has then processed all writes before
+	using Scenario = std::function<std::vector<int>(MotorID)>; // the registers written to a motor
+	auto countPackets = [&](auto&& writes, Scenario const& scenario, int round) {
+		auto before = simulator.getStats().packets;
+		writes(round);
+		int64_t reads {0};
+		for (MotorID id{1}; id <= numMotors; ++id) {
+			for (auto reg : scenario(id)) {
+				++reads;
+				auto expected = dataOf(reg, id, round);
+				auto [timeoutFlag, motorID, errorCode, data] = usb2dyn.read(id, reg, expected.size(), timeout);
+				if (timeoutFlag or data != expected) {
+					throw std::runtime_error(name + ": register " + std::to_string(reg) + " of motor " + std::to_string(int(id)) + " was not written");
+				}
+			}
+		}
+		return simulator.getStats().packets - before - reads;
+	};
+
+	auto direct = [&](Scenario const& scenario) {
+		return [&](int round) {
+			for (MotorID id{1}; id <= numMotors; ++id) {
+				for (auto reg : scenario(id)) {
+					usb2dyn.write(id, reg, dataOf(reg, id, round));
+				}
+			}
+		};
+	};
+	WriteCoalescer coalescer{usb2dyn, std::chrono::microseconds{-1}};
+	auto coalesced = [&](Scenario const& scenario) {
+		return [&](int round) {
+			for (MotorID id{1}; id <= numMotors; ++id) {
+				for (auto reg : scenario(id)) {
+					coalescer.write(id, reg, dataOf(reg, id, round));
+				}
+			}
+			coalescer.flush();
+		};
+	};
+
+	std::vector<std::tuple<std::string, Scenario>> scenarios {
+		{"goal position", [&](MotorID) { return std::vector<int>{goalPosition}; }},
+		{"goal position and led", [&](MotorID) { return std::vector<int>{goalPosition, led}; }},
+		{"goal position or led", [&](MotorID id) { return std::vector<int>{id % 2 ? goalPosition : led}; }},
+	};
+	for (auto const& [description, scenario] : scenarios) {
+		auto directPackets    = countPackets(direct(scenario), scenario, 1);
+		auto coalescedPackets = countPackets(coalesced(scenario), scenario, 2);
+		std::cout << "  " << name << ": writing " << description << " of " << numMotors << " motors takes "
+		          << directPackets << " packets directly and " << coalescedPackets << " coalesced\n";
+	}
+	simulator.stop();
+}
+
+auto writeSuite = bench::RegisterSuite{"write", [] {
+	benchWrites<mx_v1::MotorLayoutInfo>(Protocol::V1);
+	benchWrites<mx_v2::MotorLayoutInfo>(Protocol::V2);
+}};
+
+}
@@ -4,6 +4,9 @@
 #include "usb2dynamixel/MotorMetaInfo.h"
 
 #include <chrono>
+#include <iostream>
 
-auto detectMotor(dynamixel::MotorID motor, dynamixel::USB2Dynamixel& usb2dyn, std::chrono::microseconds timeout) -> std::tuple<dynamixel::LayoutType, uint16_t>;
+auto detectMotor(dynamixel::MotorID motor, dynamixel::USB2Dynamixel& usb2dyn, std::chrono::microseconds timeout, std::ostream& os = std::cout) -> std::tuple<dynamixel::LayoutType, uint16_t>;
 
+// print a found motor and look up its layout
+auto reportMotor(dynamixel::MotorID motor, uint16_t modelNumber, std::ostream& os = std::cout) -> dynamixel::LayoutType;
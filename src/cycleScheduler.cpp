@@ -0,0 +1,80 @@
+#include "cycleScheduler.h"
+
+#include <iomanip>
+#include <stdexcept>
+
+CycleScheduler::CycleScheduler(std::chrono::nanoseconds period, std::function<void()> cycle)
+	: mPeriod{period}
+	, mCycle{std::move(cycle)}
+	, mTimer{period}
+{
+	if (period.count() <= 0) {
+		throw std::runtime_error("the period of a cycle must be positive");
+	}
+	mTimer.cancel();
+	mEpoll.addFD(mTimer, [this](int) { onTimer(); }, EPOLLIN, "cycle");
+}
+
+void CycleScheduler::run() {
+	mStop = false;
+	mTicks = 0;
+	mStartTime = Clock::now();
+	mTimer.reset(mPeriod);
+	while (not mStop) {
+		mEpoll.work(1, 100);
+	}
+	mTimer.cancel();
+}
+
+void CycleScheduler::stop() {
+	mStop = true;
+	mEpoll.wakeup();
+}
+
+void CycleScheduler::onTimer() {
+	auto elapsed = mTimer.getElapsed();
+	if (elapsed <= 0) {
+		return;
+	}
+	auto now = Clock::now();
+	mTicks += elapsed;
+	mStats.overruns += elapsed - 1;
+
+	auto jitter = std::max(std::chrono::nanoseconds{0}, now - (mStartTime + mTicks * mPeriod));
+	mStats.maxJitter = std::max(mStats.maxJitter, jitter);
+	int bucket = 0;
+	while ((int64_t{1} << bucket) <= std::chrono::duration_cast<std::chrono::microseconds>(jitter).count()) {
+		++bucket;
+	}
+	mStats.jitterHistogram[bucket] += 1;
+
+	mCycle();
+
+	auto cycleTime = Clock::now() - now;
+	mStats.cycles += 1;
+	mStats.maxCycleTime = std::max(mStats.maxCycleTime, std::chrono::duration_cast<std::chrono::nanoseconds>(cycleTime));
+	mStats.accumulatedCycleTime += cycleTime;
+}
+
+void CycleScheduler::printStats(std::ostream& os) const {
+	using std::chrono::duration_cast;
+	using std::chrono::microseconds;
+	auto const& stats = mStats;
+	os << stats.cycles << " cycles, " << stats.overruns << " overruns (skipped cycles)\n";
+	if (stats.cycles == 0) {
+		return;
+	}
+	os << "cycle time: avg " << duration_cast<microseconds>(stats.accumulatedCycleTime).count() / stats.cycles << "us";
+	os << ", max " << duration_cast<microseconds>(stats.maxCycleTime).count() << "us";
+	os << " (period " << duration_cast<microseconds>(mPeriod).count() << "us)\n";
+	os << "jitter: max " << duration_cast<microseconds>(stats.maxJitter).count() << "us\n";
+
+	int64_t maxCount = 0;
+	for (auto const& [bucket, count] : stats.jitterHistogram) {
+		maxCount = std::max(maxCount, count);
+	}
+	for (auto const& [bucket, count] : stats.jitterHistogram) {
+		os << "  < " << std::setw(7) << (int64_t{1} << bucket) << "us " << std::setw(9) << count << " ";
+		os << std::string(count * 50 / maxCount, '#') << "\n";
+	}
+}
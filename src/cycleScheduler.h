@@ -0,0 +1,55 @@
+#pragma once
+
+#include <simplyfile/Epoll.h>
+#include <simplyfile/Timer.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <ostream>
+
+/**
+ * runs a cycle at a fixed rate
+ *
+ * a simplyfile::Timer fires every period and wakes up an Epoll loop which then runs the cycle.
+ * If a cycle takes longer than the period the missed timer expirations are counted as overruns and skipped,
+ * they are never run late or queued up.
+ */
+struct CycleScheduler {
+	using Clock = std::chrono::steady_clock;
+
+	CycleScheduler(std::chrono::nanoseconds period, std::function<void()> cycle);
+
+	// run cycles until stop() is called
+	void run();
+	// can be called from any thread (not from a signal handler)
+	void stop();
+
+	struct Stats {
+		int64_t cycles {0};
+		int64_t overruns {0}; // timer expirations that were skipped because a cycle ran too long
+		std::chrono::nanoseconds maxJitter {0};    // max delay of a cycle start to its scheduled time
+		std::chrono::nanoseconds maxCycleTime {0};
+		std::chrono::nanoseconds accumulatedCycleTime {0};
+		// jitter histogram: bucket i holds the cycles whose jitter was below 2^i us
+		std::map<int, int64_t> jitterHistogram;
+	};
+	[[nodiscard]] auto getStats() const -> Stats const& { return mStats; }
+
+	void printStats(std::ostream& os) const;
+
+private:
+	void onTimer();
+
+	std::chrono::nanoseconds mPeriod;
+	std::function<void()> mCycle;
+
+	simplyfile::Epoll mEpoll;
+	simplyfile::Timer mTimer;
+	std::atomic<bool> mStop {false};
+
+	Clock::time_point mStartTime;
+	int64_t mTicks {0};
+	Stats mStats;
+};
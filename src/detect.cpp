@@ -5,7 +5,14 @@
 #include "commonTasks.h"
 
 #include <algorithm>
+#include <deque>
+#include <future>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
 #include <numeric>
+#include <sstream>
 
 #define TERM_RED                        "\033[31m"
 #define TERM_GREEN                      "\033[32m"
@@ -18,7 +25,8 @@ auto detectCmd  = sargp::Command{{"", "detect"}, "detect all dynamixel motors",
 auto baudrates  = detectCmd.Parameter<std::set<int>>({57142}, "other_baudrates", "more baudrates to test", {}, &listTypicalBaudrates);
 auto readAll    = detectCmd.Flag("read_all", "read all registers from the detected motors (instead of just printing the found motors)");
 auto ids        = detectCmd.Parameter<std::set<int>>({}, "ids", "the target Id");
-auto optCont    = detectCmd.Flag("continues", "runs bulk read repeatably after detecting motors");
+auto optCont    = detectCmd.Flag("continues", "runs bulk read (or sync read for protocol v2) repeatably after detecting motors");
+auto fast       = detectCmd.Flag("fast", "scan with timeouts derived from the baudrate (see --auto_timeout) and find protocol v2 motors with a single broadcast ping");
 
 
 using namespace dynamixel;
@@ -43,17 +51,19 @@ auto readDetailedInfosFromUnknown(dynamixel::USB2Dynamixel& usb2dyn, std::vector
 	}
 	auto response = usb2dyn.bulk_read(request, timeout);
 
-	if (not response.empty()) {
-		successfullTransactions = 1 + response.size();
+	auto received = std::count_if(begin(response), end(response), [](auto const& r) { return not std::get<0>(r); });
+	if (received > 0) {
+		successfullTransactions = 1 + received;
 	}
 	if (not _print) {
 		return {successfullTransactions, expectedTransactions};
 	}
 
-	if (response.size() != motors.size()) {
-		std::cout << "couldn't retrieve detailed information from all motors\n";
-	}
-	for (auto const& [motorID, baseRegister, errorCode, rxBuf] : response) {
+	for (auto const& [timeoutFlag, motorID, baseRegister, errorCode, rxBuf] : response) {
+		if (timeoutFlag) {
+			std::cout << "couldn't retrieve detailed information from motor " << static_cast<int>(motorID) << "\n";
+			continue;
+		}
 		std::cout << "found motor " << static_cast<int>(motorID) << "\n";
 		std::cout << "registers:\n";
 		for (size_t idx{0}; idx < rxBuf.size(); ++idx) {
@@ -72,7 +82,10 @@ auto readDetailedInfos(dynamixel::USB2Dynamixel& usb2dyn, std::vector<std::tuple
 	int expectedTransactions = 1 + motors.size();
 	int successfullTransactions = 0;
 
-	auto response = usb2dyn.bulk_read<Layout::BaseRegister, Layout::Length>(motors, timeout);
+	// all motors of this group share the same register window, prefer the smaller sync read request if possible
+	auto response = usb2dyn.supportsSyncRead()
+		? usb2dyn.sync_read<Layout::BaseRegister, Layout::Length>(motors, timeout)
+		: usb2dyn.bulk_read<Layout::BaseRegister, Layout::Length>(motors, timeout);
 	if (not response.empty()) {
 		successfullTransactions = 1 + response.size();
 	}
@@ -80,8 +93,11 @@ auto readDetailedInfos(dynamixel::USB2Dynamixel& usb2dyn, std::vector<std::tuple
 		return {successfullTransactions, expectedTransactions};
 	}
 
-	if (response.size() != motors.size()) {
-		std::cout << "couldn't retrieve detailed information from all motors\n";
+	for (auto const& [id, modelNumber] : motors) {
+		bool replied = std::any_of(begin(response), end(response), [id=id](auto const& r) { return std::get<0>(r) == id; });
+		if (not replied) {
+			std::cout << "couldn't retrieve detailed information from motor " << static_cast<int>(id) << "\n";
+		}
 	}
 
 	std::cout << "             ";
@@ -139,78 +155,207 @@ auto readDetailedInfos(dynamixel::USB2Dynamixel& usb2dyn, std::vector<std::tuple
 	return {successfullTransactions, expectedTransactions};
 }
 
-void runDetect() {
-	baudrates->emplace(*g_baudrate);
-	auto timeout = std::chrono::microseconds{*g_timeout};
-	auto protocols = std::vector<dynamixel::Protocol>{dynamixel::Protocol::V1, dynamixel::Protocol::V2};
-	if (g_protocolVersion) {
-		protocols = {dynamixel::Protocol{*g_protocolVersion}};
+using MotorsByLayout = std::map<LayoutType, std::vector<std::tuple<MotorID, uint16_t>>>;
+
+struct ScanResult {
+	std::string device;
+	Protocol protocol;
+	int baudrate;
+	MotorsByLayout motors;
+};
+
+auto scanBus(USB2Dynamixel& usb2dyn, std::vector<int> const& range, std::chrono::microseconds timeout, std::ostream& os) -> MotorsByLayout {
+	MotorsByLayout motors;
+	if (fast and usb2dyn.getProtocol() == Protocol::V2) {
+		for (auto [id, modelNumber] : usb2dyn.broadcast_ping(USB2Dynamixel::AutoTimeout)) {
+			if (std::find(begin(range), end(range), int(id)) != end(range)) {
+				motors[reportMotor(id, modelNumber, os)].push_back(std::make_tuple(id, modelNumber));
+			}
+		}
+		return motors;
+	}
+	if (fast) {
+		timeout = USB2Dynamixel::AutoTimeout;
 	}
+	for (auto motor : range) {
+		auto [layout, modelNumber] = detectMotor(MotorID(motor), usb2dyn, timeout, os);
+		if (modelNumber != 0) {
+			motors[layout].push_back(std::make_tuple(motor, modelNumber));
+		}
+	}
+	return motors;
+}
+
+// try all protocols and baudrates on one device
+auto scanDevice(std::string const& device, std::vector<Protocol> const& protocols, std::set<int> const& bauds, std::vector<int> const& range, std::chrono::microseconds timeout, std::ostream& os) -> std::vector<ScanResult> {
+	std::vector<ScanResult> results;
 	for (auto protocolVersion : protocols) {
-		std::cout << "# trying protocol version " << int(protocolVersion) << "\n";
-		for (auto baudrate : *baudrates) {
-			std::cout << "## trying baudrate: " << baudrate << "\n";
-			auto usb2dyn = dynamixel::USB2Dynamixel(baudrate, *g_device, protocolVersion);
-
-			// generate range to check
-			std::vector<int> range(0xFD);
-			std::iota(begin(range), end(range), 0);
-			if (g_id) {
-				range = {*g_id};
-			} else  if (ids) {
-				range.clear();
-				for (auto x : *ids) {
-					range.push_back(x);
-				}
+		os << "# trying protocol version " << int(protocolVersion) << "\n";
+		for (auto baudrate : bauds) {
+			os << "## trying baudrate: " << baudrate << "\n";
+			auto usb2dyn = USB2Dynamixel(baudrate, device, protocolVersion);
+			configureTiming(usb2dyn);
+			auto motors = scanBus(usb2dyn, range, timeout, os);
+			if (not motors.empty()) {
+				results.push_back({device, protocolVersion, baudrate, std::move(motors)});
 			}
+		}
+	}
+	return results;
+}
+
+// with --devices several buses are read at once, their output is printed one iteration at a time
+std::mutex outputMutex;
 
-			// ping all motors
-			std::map<LayoutType, std::vector<std::tuple<MotorID, uint16_t>>> motors;
-			for (auto motor : range) {
-				auto [layout, modelNumber] = detectMotor(MotorID(motor), usb2dyn, timeout);
-				if (modelNumber != 0) {
-					motors[layout].push_back(std::make_tuple(motor, modelNumber));
+// reads all registers of the motors of a scan result, one step at a time
+struct MotorReader {
+	MotorReader(ScanResult& _result, std::chrono::microseconds _timeout)
+		: result{_result}
+		, timeout{_timeout}
+	{}
+
+	void open() {
+		auto& port = usb2dyn.emplace(result.baudrate, result.device, result.protocol);
+		configureTiming(port);
+		if (timeout == USB2Dynamixel::AutoTimeout) {
+			for (auto const& [layout, motorList] : result.motors) {
+				for (auto const& [id, modelNumber] : motorList) {
+					port.calibrateReturnDelay(id, layout, timeout);
 				}
 			}
-			// read detailed infos if requested
-			if ((readAll or optCont) and not motors.empty()) {
-				static int count = 0;
-				static int successful = 0;
-				static int total = 0;
-				auto start = std::chrono::high_resolution_clock::now();
-				auto lastPrint = start;
-				do {
-					count += 1;
-					auto now = std::chrono::high_resolution_clock::now();
-					auto diff = std::chrono::duration_cast<std::chrono::milliseconds>(now - lastPrint);
-					bool print = (diff.count() > 100) or readAll;
-
-					meta::forAllLayoutTypes([&](auto const& info) {
-						using Info = std::decay_t<decltype(info)>;
-						if (not motors[Info::Type].empty()) {
-							using FullLayout = typename Info::FullLayout;
-							auto [suc, tot] = readDetailedInfos<Info::Type, FullLayout>(usb2dyn, motors[Info::Type], timeout, print);
-							successful += suc;
-							total += tot;
-						}
-					});
+		}
+	}
+	void step() {
+		if (not usb2dyn) {
+			open();
+		} else if (shared) {
+			usb2dyn->setBaudrate(result.baudrate);
+		}
+		auto& motors = result.motors;
+		count += 1;
+		auto now = std::chrono::high_resolution_clock::now();
+		auto diff = std::chrono::duration_cast<std::chrono::milliseconds>(now - lastPrint);
+		bool print = (diff.count() > 100) or readAll;
+		auto outputLock = print ? std::unique_lock(outputMutex) : std::unique_lock<std::mutex>{};
+		if (print and g_devices) {
+			std::cout << "# reading from " << result.device << " with protocol version " << int(result.protocol) << " at baudrate " << result.baudrate << "\n";
+		}
 
-					if (not motors[LayoutType::None].empty()) {
-						auto [suc, tot] = readDetailedInfosFromUnknown(usb2dyn, motors[LayoutType::None], timeout, print);
-						successful += suc;
-						total += tot;
-					}
-					if (print and optCont) {
-						lastPrint = now;
-						std::cout << successful << "/" << total << " successful/total transactions - ";
-						std::cout << count << " loops\n";
-						auto now = std::chrono::high_resolution_clock::now();
-						auto diff = std::chrono::duration_cast<std::chrono::milliseconds>(now - start);
-						std::cout << double(successful) / diff.count() * 1000. << "/" << double(total) / diff.count() * 1000. << " trans per second -        ";
-						std::cout << double(count) / diff.count() * 1000. << " loops per second" << "\n";
-					}
-				} while (optCont);
+		meta::forAllLayoutTypes([&](auto const& info) {
+			using Info = std::decay_t<decltype(info)>;
+			if (not motors[Info::Type].empty()) {
+				using FullLayout = typename Info::FullLayout;
+				auto [suc, tot] = readDetailedInfos<Info::Type, FullLayout>(*usb2dyn, motors[Info::Type], timeout, print);
+				successful += suc;
+				total += tot;
 			}
+		});
+
+		if (not motors[LayoutType::None].empty()) {
+			auto [suc, tot] = readDetailedInfosFromUnknown(*usb2dyn, motors[LayoutType::None], timeout, print);
+			successful += suc;
+			total += tot;
+		}
+		if (print and optCont) {
+			lastPrint = now;
+			std::cout << successful << "/" << total << " successful/total transactions - ";
+			std::cout << count << " loops\n";
+			auto now = std::chrono::high_resolution_clock::now();
+			auto diff = std::chrono::duration_cast<std::chrono::milliseconds>(now - start);
+			std::cout << double(successful) / diff.count() * 1000. << "/" << double(total) / diff.count() * 1000. << " trans per second -        ";
+			std::cout << double(count) / diff.count() * 1000. << " loops per second" << "\n";
+			auto stats = usb2dyn->getReceptionStats();
+			auto cpuTime  = std::chrono::duration_cast<std::chrono::microseconds>(stats.cpuTime);
+			auto wallTime = std::chrono::duration_cast<std::chrono::microseconds>(stats.wallTime);
+			std::cout << "reception: " << cpuTime.count() << "us cpu time / " << wallTime.count() << "us wall time (";
+			std::cout << (wallTime.count()?100. * cpuTime.count() / wallTime.count():0.) << "% cpu load)\n";
+		}
+	}
+
+	ScanResult& result;
+	std::chrono::microseconds timeout;
+	std::optional<USB2Dynamixel> usb2dyn;
+	// the device carries several protocols or baudrates and every reader keeps its own port open, each step configures the baudrate again
+	bool shared {false};
+	int count {0};
+	int successful {0};
+	int total {0};
+	std::chrono::high_resolution_clock::time_point start {std::chrono::high_resolution_clock::now()};
+	std::chrono::high_resolution_clock::time_point lastPrint {start};
+};
+
+// read the motors of all results of one device, over and over with --continues
+void readMotors(std::vector<ScanResult*> const& results, std::chrono::microseconds timeout) {
+	std::deque<MotorReader> readers;
+	for (auto result : results) {
+		readers.emplace_back(*result, timeout).shared = results.size() > 1;
+	}
+	do {
+		for (auto& reader : readers) {
+			reader.step();
+		}
+	} while (optCont);
+}
+
+void runDetect() {
+	baudrates->emplace(*g_baudrate);
+	auto timeout = getTimeout();
+	auto protocols = std::vector<dynamixel::Protocol>{dynamixel::Protocol::V1, dynamixel::Protocol::V2};
+	if (g_protocolVersion) {
+		protocols = {dynamixel::Protocol{*g_protocolVersion}};
+	}
+
+	// generate range to check
+	std::vector<int> range(0xFD);
+	std::iota(begin(range), end(range), 0);
+	if (g_id) {
+		range = {*g_id};
+	} else  if (ids) {
+		range.clear();
+		for (auto x : *ids) {
+			range.push_back(x);
+		}
+	}
+
+	std::vector<ScanResult> results;
+	if (not g_devices) {
+		results = scanDevice(*g_device, protocols, *baudrates, range, timeout, std::cout);
+	} else {
+		// every device is scanned on its own thread, the output is printed per device once all are done
+		// a baudrate or protocol given with the device is the only one scanned on it
+		auto specs = getDeviceSpecs();
+		std::vector<std::stringstream> logs(specs.size());
+		std::vector<std::future<std::vector<ScanResult>>> futures;
+		for (std::size_t idx{0}; idx < specs.size(); ++idx) {
+			futures.emplace_back(std::async(std::launch::async, [&, idx] {
+				auto const& spec = specs[idx];
+				auto deviceProtocols = spec.hasProtocol ? std::vector<Protocol>{spec.config.protocol} : protocols;
+				auto deviceBaudrates = spec.hasBaudrate ? std::set<int>{spec.config.baudrate} : *baudrates;
+				return scanDevice(spec.config.device, deviceProtocols, deviceBaudrates, range, timeout, logs[idx]);
+			}));
+		}
+		for (std::size_t idx{0}; idx < specs.size(); ++idx) {
+			auto deviceResults = futures[idx].get();
+			std::cout << "# device " << specs[idx].config.device << "\n" << logs[idx].str();
+			results.insert(end(results), begin(deviceResults), end(deviceResults));
+		}
+	}
+
+	// read detailed infos if requested
+	if (readAll or optCont) {
+		// every device is read on its own thread (with --continues readMotors never returns)
+		std::map<std::string, std::vector<ScanResult*>> resultsByDevice;
+		for (auto& result : results) {
+			resultsByDevice[result.device].push_back(&result);
+		}
+		std::vector<std::future<void>> futures;
+		for (auto const& [device, deviceResults] : resultsByDevice) {
+			futures.emplace_back(std::async(std::launch::async, [&, &deviceResults = deviceResults] {
+				readMotors(deviceResults, timeout);
+			}));
+		}
+		for (auto& future : futures) {
+			future.get();
 		}
 	}
 }
@@ -1,5 +1,7 @@
 #include "usb2dynamixel/USB2Dynamixel.h"
 #include "usb2dynamixel/MotorMetaInfo.h"
+#include "usb2dynamixel/SnapshotCache.h"
+#include "usb2dynamixel/WriteCoalescer.h"
 #include "globalOptions.h"
 #include "commonTasks.h"
 
@@ -10,6 +12,12 @@
 #include <numeric>
 #include <atomic>
 #include <future>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string_view>
+#include <thread>
 
 #include <unistd.h>
 #include <functional>
@@ -22,14 +30,39 @@ auto interactCmd  = sargp::Command{"fuse", "create a fuse fs representing the co
 auto optTimeout   = interactCmd.Parameter<int>(10000, "timeout", "timeout in us");
 auto ids          = interactCmd.Parameter<std::set<int>>({}, "ids", "the target Id");
 auto mountPoint   = interactCmd.Parameter<std::string>("dynamixelFS", "mountpoint", "where to mount the fuse filesystem representing the motors");
+auto freshness    = interactCmd.Parameter<int>(10000, "freshness", "register files are served from a snapshot of their motor that is at most this many us old, outdated snapshots are refreshed together");
+auto sampleInterval = interactCmd.Parameter<int>(20000, "sample_interval", "registers somebody waits for with poll/select are sampled every this many us, the waiting readers are woken when the value changes");
+auto writeWindow  = interactCmd.Parameter<int>(0, "write_window", "writes to register files are held for this many us and then sent together (one sync write per register or a bulk write), 0: write right away, -1: hold until something is written to /commit");
+auto workers      = interactCmd.Parameter<int>(4, "workers", "number of threads serving reads and writes of files, metadata requests are served by a thread of their own (0: serve all requests one after another)");
 using namespace dynamixel;
 
+// the value of a register as rendered by the register files (at most the first four bytes, little endian)
+int decodeValue(std::byte const* data, std::size_t length) {
+	int value {0};
+	memcpy(&value, data, std::min(sizeof(value), length));
+	return value;
+}
+
+// serve the bytes [offset, offset + size) of content
+int readContent(std::string_view content, char* buf, std::size_t size, off_t offset) {
+	if (offset < 0 or std::size_t(offset) >= content.size()) {
+		return 0;
+	}
+	size = std::min(size, content.size() - std::size_t(offset));
+	std::memcpy(buf, content.data() + offset, size);
+	return size;
+}
+
+struct RegisterSampler;
+
 struct RegisterFile : simplyfuse::FuseFile {
-	RegisterFile(MotorID _motorID, int _registerID, meta::LayoutField const& _layoutField, USB2Dynamixel &_usb2dyn)
+	RegisterFile(MotorID _motorID, int _registerID, meta::LayoutField const& _layoutField, WriteCoalescer& _writer, SnapshotCache& _cache, RegisterSampler& _sampler)
 		: motorID(_motorID)
 		, registerID(_registerID)
 		, layoutField(_layoutField)
-		, usb2dyn(_usb2dyn)
+		, writer(_writer)
+		, cache(_cache)
+		, sampler(_sampler)
 	{}
 
 	virtual ~RegisterFile() = default;
@@ -38,14 +71,11 @@ struct RegisterFile : simplyfuse::FuseFile {
 		if (not (int(layoutField.access) & int(meta::LayoutField::Access::R))) {
 			return -EINVAL;
 		}
-		auto [timeout, motor, error, parameters] = usb2dyn.read(motorID, registerID, layoutField.length, std::chrono::microseconds{g_timeout});
-		if (timeout or motor != motorID or parameters.size() != layoutField.length) {
+		auto content = readValue();
+		if (not content) {
 			return -EINVAL;
 		}
-		int content {0};
-		memcpy(&content, parameters.data(), std::min(sizeof(content), std::size_t(layoutField.length)));
-
-		std::string renderedContent = std::to_string(content) + "\n";
+		std::string renderedContent = std::to_string(*content) + "\n";
 		size = std::min(size, renderedContent.size()+1);
 		std::memcpy(buf, renderedContent.data(), size);
 		return size;
@@ -63,7 +93,8 @@ struct RegisterFile : simplyfuse::FuseFile {
 			for (std::size_t i{0}; i < layoutField.length; ++i) {
 				param.emplace_back(std::byte{reinterpret_cast<uint8_t const*>(&toSet)[i]});
 			}
-			usb2dyn.write(motorID, registerID, param);
+			writer.write(motorID, registerID, std::move(param));
+			cache.invalidate(motorID);
 			return size;
 		} catch (std::exception const&) {}
 		return -ENOENT;
@@ -88,10 +119,293 @@ struct RegisterFile : simplyfuse::FuseFile {
 		return permissions;
 	}
 
+	// the sampler watches this register while somebody waits for a change of it
+	void onPoll() override;
+
+	// read the register and wake the pollers if it changed, called by the sampler
+	void sample() {
+		readValue();
+	}
+
+	std::optional<int> readValue() {
+		Parameter parameters(layoutField.length);
+		if (not cache.read(motorID, registerID, parameters.size(), parameters.data(), std::chrono::microseconds{g_timeout})) {
+			return std::nullopt;
+		}
+		int content = decodeValue(parameters.data(), parameters.size());
+
+		bool changed {false};
+		{
+			auto g = std::lock_guard(valueMutex);
+			changed = lastValue and *lastValue != content;
+			lastValue = content;
+		}
+		if (changed) {
+			notifyChanged();
+		}
+		return content;
+	}
+
 	MotorID motorID;
 	int registerID;
 	meta::LayoutField layoutField;
-	USB2Dynamixel &usb2dyn;
+	WriteCoalescer& writer;
+	SnapshotCache& cache;
+	RegisterSampler& sampler;
+
+	std::mutex valueMutex;
+	std::optional<int> lastValue; // the value last read by anybody
+};
+
+/**
+ * samples the registers somebody waits for (poll/select on a register file) and wakes the waiting readers when a value
+ * changes. All waiting scripts share this one sampling stream, its reads go through the snapshot cache and are
+ * batched like any other read.
+ */
+struct RegisterSampler {
+	RegisterSampler(std::chrono::microseconds _interval)
+		: interval{_interval}
+		, thread{[this]{ run(); }}
+	{}
+	~RegisterSampler() {
+		stop = true;
+		thread.join();
+	}
+
+	void subscribe(RegisterFile& file) {
+		auto g = std::lock_guard(mutex);
+		subscribed.insert(&file);
+	}
+
+private:
+	void run() {
+		while (not stop) {
+			auto next = std::chrono::steady_clock::now() + interval;
+			// registers nobody waits for anymore are dropped
+			std::vector<RegisterFile*> files;
+			{
+				auto g = std::lock_guard(mutex);
+				for (auto iter = subscribed.begin(); iter != subscribed.end();) {
+					if ((*iter)->hasPollers()) {
+						files.push_back(*iter);
+						++iter;
+					} else {
+						iter = subscribed.erase(iter);
+					}
+				}
+			}
+			for (auto file : files) {
+				try {
+					file->sample();
+				} catch (std::exception const&) {}
+			}
+			std::this_thread::sleep_until(next);
+		}
+	}
+
+	std::chrono::microseconds interval;
+	std::mutex mutex;
+	std::set<RegisterFile*> subscribed;
+	std::atomic<bool> stop {false};
+	std::thread thread;
+};
+
+void RegisterFile::onPoll() {
+	sampler.subscribe(*this);
+}
+
+/**
+ * the detected motors and their readable registers, used by the files that aggregate over all motors
+ */
+struct Fleet {
+	struct Motor {
+		LayoutType layout;
+		std::vector<std::tuple<int, std::size_t, std::string>> registers; // readable [register, length, name] in ascending order
+	};
+
+	void setMotor(MotorID id, Motor motor) {
+		auto g = std::lock_guard(mutex);
+		motors[id] = std::move(motor);
+	}
+	[[nodiscard]] auto getMotors() const -> std::map<MotorID, Motor> {
+		auto g = std::lock_guard(mutex);
+		return motors;
+	}
+
+private:
+	mutable std::mutex mutex;
+	std::map<MotorID, Motor> motors;
+};
+
+// /<id>/snapshot.bin: the raw bytes of the full layout of a motor, taken with a single read
+struct SnapshotBinFile : simplyfuse::FuseFile {
+	SnapshotBinFile(MotorID _motorID, int _baseRegister, std::size_t _length, USB2Dynamixel& _usb2dyn)
+		: motorID(_motorID)
+		, baseRegister(_baseRegister)
+		, length(_length)
+		, usb2dyn(_usb2dyn)
+	{}
+
+	int onRead(char* buf, std::size_t size, off_t offset) override {
+		Parameter data(length);
+		auto [timeoutFlag, motor, errorCode] = usb2dyn.read(motorID, baseRegister, data.data(), length, std::chrono::microseconds{g_timeout});
+		if (timeoutFlag or motor != motorID) {
+			return -EINVAL;
+		}
+		return readContent({reinterpret_cast<char const*>(data.data()), data.size()}, buf, size, offset);
+	}
+
+	std::size_t getSize() override {
+		return length;
+	}
+
+	int getFilePermissions() override {
+		return 0444;
+	}
+
+	MotorID motorID;
+	int baseRegister;
+	std::size_t length;
+	USB2Dynamixel& usb2dyn;
+};
+
+/**
+ * a text file that aggregates over all motors
+ * every opened file handle renders it on its read at offset 0 and serves its reads at later offsets from that rendering,
+ * hence a file that is read in several chunks is consistent. Its real size is only known once it is rendered.
+ */
+struct AggregateFile : simplyfuse::FuseFile {
+	int onHandleRead(uint64_t handle, char* buf, std::size_t size, off_t offset) override {
+		if (offset != 0) {
+			auto g = std::lock_guard(renderingsMutex);
+			auto iter = renderings.find(handle);
+			if (iter != renderings.end()) {
+				return readContent(iter->second, buf, size, offset);
+			}
+		}
+		auto content = render();
+		auto g = std::lock_guard(renderingsMutex);
+		auto& rendering = renderings[handle] = std::move(content);
+		return readContent(rendering, buf, size, offset);
+	}
+
+	void onHandleRelease(uint64_t handle) override {
+		auto g = std::lock_guard(renderingsMutex);
+		renderings.erase(handle);
+	}
+
+	std::size_t getSize() override {
+		return 1 << 20;
+	}
+
+	int getFilePermissions() override {
+		return 0444;
+	}
+
+private:
+	virtual auto render() -> std::string = 0;
+
+	std::mutex renderingsMutex;
+	std::map<uint64_t, std::string> renderings; // the content as rendered for every open file handle
+};
+
+// /all/<register>: "<id> <value>" of every motor that has the register, filled by a single sync read or bulk read
+struct RegisterColumnFile : AggregateFile {
+	RegisterColumnFile(std::string _name, Fleet const& _fleet, USB2Dynamixel& _usb2dyn)
+		: name(std::move(_name))
+		, fleet(_fleet)
+		, usb2dyn(_usb2dyn)
+	{}
+
+private:
+	auto render() -> std::string override {
+		// the register may sit at a different address for every layout
+		std::vector<std::tuple<MotorID, int, std::size_t>> request;
+		for (auto const& [id, motor] : fleet.getMotors()) {
+			for (auto const& [reg, length, registerName] : motor.registers) {
+				if (registerName == name) {
+					request.emplace_back(id, reg, length);
+				}
+			}
+		}
+		if (request.empty()) {
+			return {};
+		}
+		auto sameRegister = std::all_of(begin(request), end(request), [&](auto const& r) {
+			return std::get<1>(r) == std::get<1>(request.front()) and std::get<2>(r) == std::get<2>(request.front());
+		});
+		auto read = [&] {
+			if (sameRegister and usb2dyn.supportsSyncRead()) {
+				std::vector<MotorID> motors;
+				for (auto const& r : request) {
+					motors.push_back(std::get<0>(r));
+				}
+				return usb2dyn.prepareSyncRead(motors, std::get<1>(request.front()), std::get<2>(request.front()));
+			}
+			return usb2dyn.prepareBulkRead(request);
+		}();
+		usb2dyn.execute(read, std::chrono::microseconds{g_timeout});
+
+		std::string content;
+		for (std::size_t idx{0}; idx < request.size(); ++idx) {
+			if (read.hasReplied(idx)) {
+				auto data = read.getData(idx);
+				content += std::to_string(int(std::get<0>(request[idx]))) + " " + std::to_string(decodeValue(data.data(), data.size())) + "\n";
+			}
+		}
+		return content;
+	}
+
+	std::string name;
+	Fleet const& fleet;
+	USB2Dynamixel& usb2dyn;
+};
+
+// /all/snapshot.csv: every readable register of every motor, a row per motor and a column per register name
+struct FleetCsvFile : AggregateFile {
+	FleetCsvFile(Fleet const& _fleet, SnapshotCache& _cache)
+		: fleet(_fleet)
+		, cache(_cache)
+	{}
+
+private:
+	auto render() -> std::string override {
+		auto motors = fleet.getMotors();
+		std::vector<std::string> columns;
+		for (auto const& [id, motor] : motors) {
+			for (auto const& [reg, length, name] : motor.registers) {
+				if (std::find(begin(columns), end(columns), name) == end(columns)) {
+					columns.push_back(name);
+				}
+			}
+		}
+		std::string content = "id";
+		for (auto const& column : columns) {
+			content += "," + column;
+		}
+		content += "\n";
+		// all rows come from one copy of the snapshots, a refresh while rendering can't mix in newer values
+		auto tables = cache.snapshotAll(std::chrono::microseconds{g_timeout});
+		for (auto const& [id, motor] : motors) {
+			std::vector<std::string> values(columns.size());
+			auto table = tables.find(id);
+			for (auto const& [reg, length, name] : motor.registers) {
+				if (table != tables.end() and reg + length <= table->second.size()) {
+					auto column = std::find(begin(columns), end(columns), name) - begin(columns);
+					values[column] = std::to_string(decodeValue(table->second.data() + reg, length));
+				}
+			}
+			content += std::to_string(int(id));
+			for (auto const& value : values) {
+				content += "," + value;
+			}
+			content += "\n";
+		}
+		return content;
+	}
+
+	Fleet const& fleet;
+	SnapshotCache& cache;
 };
 
 struct PingFile : simplyfuse::SimpleWOFile {
@@ -112,10 +426,30 @@ struct PingFile : simplyfuse::SimpleWOFile {
 	}
 };
 
+// /commit: sends the register writes that are held by the write coalescer
+// fails with EIO if that or an earlier flush of the write window failed
+struct CommitFile : simplyfuse::SimpleWOFile {
+	WriteCoalescer& writer;
+	CommitFile(WriteCoalescer& _writer) : writer{_writer} {}
+
+	int onWrite(const char*, std::size_t size, off_t) override {
+		bool failed {false};
+		try {
+			writer.flush();
+		} catch (std::exception const&) {
+			failed = true;
+		}
+		if (writer.takeFailure() or failed) {
+			return -EIO;
+		}
+		return size;
+	}
+};
+
 std::atomic<bool> terminateFlag {false};
 
 template <LayoutType LT>
-std::vector<std::unique_ptr<simplyfuse::FuseFile>> registerMotor(MotorID motorID, int modelNumber, USB2Dynamixel& usb2dyn, simplyfuse::FuseFS& fuseFS) {
+std::vector<std::unique_ptr<simplyfuse::FuseFile>> registerMotor(MotorID motorID, int modelNumber, USB2Dynamixel& usb2dyn, WriteCoalescer& writer, SnapshotCache& cache, RegisterSampler& sampler, Fleet& fleet, simplyfuse::FuseFS& fuseFS) {
 	std::vector<std::unique_ptr<simplyfuse::FuseFile>> files;
 
 	auto motorInfoPtr = meta::getMotorInfo(modelNumber);
@@ -124,21 +458,39 @@ std::vector<std::unique_ptr<simplyfuse::FuseFile>> registerMotor(MotorID motorID
 	fuseFS.registerFile("/" + std::to_string(motorID) + "/motor_model", *motorModelFile);
 
 	using Info = meta::MotorLayoutInfo<LT>;
+	auto& snapshotFile = files.emplace_back(std::make_unique<SnapshotBinFile>(motorID, int(Info::FullLayout::BaseRegister), std::size_t(Info::FullLayout::Length), usb2dyn));
+	fuseFS.registerFile("/" + std::to_string(motorID) + "/snapshot.bin", *snapshotFile);
+
 	auto const& defaults = Info::getDefaults().at(modelNumber).defaultLayout;
 	auto const& infos    = Info::getInfos();
+	std::vector<std::tuple<int, std::size_t>> readable;
+	Fleet::Motor fleetMotor {LT, {}};
 	for (auto const& [reg, entry] : defaults) {
 		//!TODO should register convert function here
 		auto const& info = infos.at(reg);
-		auto& newFile = files.emplace_back(std::make_unique<RegisterFile>(motorID, int(reg), info, usb2dyn));
+		auto& newFile = files.emplace_back(std::make_unique<RegisterFile>(motorID, int(reg), info, writer, cache, sampler));
 		fuseFS.registerFile("/" + std::to_string(motorID) + "/by-register-name/" + info.name, *newFile);
 		fuseFS.registerFile("/" + std::to_string(motorID) + "/by-register-id/" + std::to_string(int(reg)), *newFile);
+		if (int(info.access) & int(meta::LayoutField::Access::R)) {
+			readable.emplace_back(int(reg), info.length);
+			fleetMotor.registers.emplace_back(int(reg), info.length, info.name);
+		}
 	}
+	cache.addMotor(motorID, LT, readable);
+	fleet.setMotor(motorID, std::move(fleetMotor));
 	return files;
 }
 
 void runFuse() {
 	auto timeout = std::chrono::microseconds{*g_timeout};
 	auto usb2dyn = USB2Dynamixel(*g_baudrate, *g_device, *g_protocolVersion);
+	auto cache   = SnapshotCache(usb2dyn, std::chrono::microseconds{*freshness});
+	// cached registers of written motors are outdated once the writes were sent
+	auto writer  = WriteCoalescer(usb2dyn, std::chrono::microseconds{*writeWindow}, [&](auto const& motors) {
+		for (auto motor : motors) {
+			cache.invalidate(motor);
+		}
+	});
 
 	std::vector<int> range;
 	if (g_id) {
@@ -151,21 +503,41 @@ void runFuse() {
 	}
 
 	simplyfuse::FuseFS fuseFS{*mountPoint};
+	std::mutex filesMutex;
 	std::map<MotorID, std::vector<std::unique_ptr<simplyfuse::FuseFile>>> files;
+	// files of a motor that was detected again, a worker might still be reading them
+	std::vector<std::unique_ptr<simplyfuse::FuseFile>> retiredFiles;
+	auto sampler = RegisterSampler(std::chrono::microseconds{*sampleInterval});
+	auto fleet   = Fleet{};
+	// /all/<register>, created when the first motor with the register is detected
+	std::map<std::string, std::unique_ptr<RegisterColumnFile>> columnFiles;
 
 	auto detectAndHandleMotor = [&](MotorID motor) {
 		auto [layout, modelNumber] = detectMotor(MotorID(motor), usb2dyn, timeout);
 		if (modelNumber == 0) {
 			return false;
 		}
+		auto g = std::lock_guard(filesMutex);
 		std::vector<std::unique_ptr<simplyfuse::FuseFile>> newFiles;
 		meta::forAllLayoutTypes([&](auto const& info) {
 			using Info = std::decay_t<decltype(info)>;
 			if (layout == Info::Type) {
-				newFiles= registerMotor<Info::Type>(motor, modelNumber,usb2dyn, fuseFS);
+				newFiles= registerMotor<Info::Type>(motor, modelNumber, usb2dyn, writer, cache, sampler, fleet, fuseFS);
 			}
 		});
-		files[motor] = std::move(newFiles);
+		auto motors = fleet.getMotors();
+		if (auto iter = motors.find(motor); iter != motors.end()) {
+			for (auto const& [reg, length, name] : iter->second.registers) {
+				auto& columnFile = columnFiles[name];
+				if (not columnFile) {
+					columnFile = std::make_unique<RegisterColumnFile>(name, fleet, usb2dyn);
+					fuseFS.registerFile("/all/" + name, *columnFile);
+				}
+			}
+		}
+		auto& motorFiles = files[motor];
+		std::move(begin(motorFiles), end(motorFiles), std::back_inserter(retiredFiles));
+		motorFiles = std::move(newFiles);
 		return true;
 	};
 
@@ -182,6 +554,10 @@ void runFuse() {
 
 	fuseFS.registerFile("/detect_motor", detectSingleMotor);
 	fuseFS.registerFile("/detect_all_motors", detectAllMotors);
+	auto fleetCsv = FleetCsvFile(fleet, cache);
+	fuseFS.registerFile("/all/snapshot.csv", fleetCsv);
+	auto commitFile = CommitFile(writer);
+	fuseFS.registerFile("/commit", commitFile);
 	auto future = std::async(std::launch::async, [&]{
 		// ping all motors
 		for (auto motor : range) {
@@ -195,6 +571,15 @@ void runFuse() {
 	auto sigHandler = [](int){ terminateFlag = true; };
 	std::signal(SIGINT, sigHandler);
 
+	if (*workers > 0) {
+		fuseFS.startWorkers(*workers);
+		while (not terminateFlag) {
+			std::this_thread::sleep_for(std::chrono::milliseconds{100});
+		}
+		fuseFS.stopWorkers();
+		return;
+	}
+
 	simplyfile::Epoll epoll;
 	epoll.addFD(fuseFS.getFD(), [&](int){
 		fuseFS.loop();
@@ -3,6 +3,7 @@
 #include <string>
 #include <iostream>
 #include <filesystem>
+#include <sargparse/ParameterParsing.h>
 
 namespace fs = std::filesystem;
 
@@ -54,3 +55,61 @@ auto getDefaultSerialPort() -> std::string {
 	return *devices.begin();
 }
 
+auto getDeviceSpecs() -> std::vector<DeviceSpec> {
+	std::vector<DeviceSpec> specs;
+	for (auto const& spec : *g_devices) {
+		DeviceSpec deviceSpec{{spec, *g_baudrate, *g_protocolVersion}};
+		auto& config = deviceSpec.config;
+		auto pos = spec.find(':');
+		if (pos != std::string::npos) {
+			config.device = spec.substr(0, pos);
+			auto rest = spec.substr(pos+1);
+			auto protoPos = rest.find(':');
+			auto baudrate = rest.substr(0, protoPos);
+			try {
+				if (not baudrate.empty()) {
+					config.baudrate = sargp::parsing::detail::parseFromString<int>(baudrate);
+					deviceSpec.hasBaudrate = true;
+				}
+			} catch (std::exception const&) {
+				throw std::runtime_error("invalid baudrate in device \"" + spec + "\"");
+			}
+			if (protoPos != std::string::npos) {
+				auto protocol = rest.substr(protoPos+1);
+				if (protocol == "1") {
+					config.protocol = dynamixel::Protocol::V1;
+				} else if (protocol == "2") {
+					config.protocol = dynamixel::Protocol::V2;
+				} else {
+					throw std::runtime_error("invalid protocol version in device \"" + spec + "\"");
+				}
+				deviceSpec.hasProtocol = true;
+			}
+		}
+		specs.push_back(deviceSpec);
+	}
+	return specs;
+}
+
+auto getBusConfigs() -> std::vector<dynamixel::MultiBus::BusConfig> {
+	if (not g_devices) {
+		return {{*g_device, *g_baudrate, *g_protocolVersion}};
+	}
+	std::vector<dynamixel::MultiBus::BusConfig> configs;
+	for (auto const& spec : getDeviceSpecs()) {
+		configs.push_back(spec.config);
+	}
+	return configs;
+}
+
+auto getTimeout() -> std::chrono::microseconds {
+	if (g_autoTimeout) {
+		return dynamixel::USB2Dynamixel::AutoTimeout;
+	}
+	return std::chrono::microseconds{*g_timeout};
+}
+
+void configureTiming(dynamixel::USB2Dynamixel& usb2dyn) {
+	usb2dyn.setLatency(std::chrono::microseconds{*g_latency});
+	usb2dyn.setLearnLatency(g_learnLatency);
+}
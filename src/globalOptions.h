@@ -2,6 +2,7 @@
 
 #include <sargparse/Parameter.h>
 #include "usb2dynamixel/USB2Dynamixel.h"
+#include "usb2dynamixel/MultiBus.h"
 
 
 auto listDeviceFiles(std::vector<std::string> const& _str) -> std::pair<bool, std::set<std::string>>;
@@ -13,7 +14,26 @@ inline auto g_device          = sargp::Parameter<std::string>(getDefaultSerialPo
 inline auto g_id              = sargp::Parameter<int>(0, "id", "the target Id (values: 0x00 - 0xfd)");
 inline auto g_baudrate        = sargp::Parameter<int>(1000000, "baudrate", "baudrate to use (e.g.: 1m)", {}, &listTypicalBaudrates);
 inline auto g_timeout         = sargp::Parameter<int>(10000, "timeout", "timeout in us");
+inline auto g_autoTimeout     = sargp::Flag("auto_timeout", "derive the timeout of every transaction from baudrate, packet sizes and return delay instead of using --timeout");
+inline auto g_latency         = sargp::Parameter<int>(1000, "latency", "latency of the usb adapter in us, used by --auto_timeout");
+inline auto g_learnLatency    = sargp::Flag("learn_latency", "refine --latency from the observed reply times");
 inline auto g_protocolVersion = sargp::Choice<dynamixel::Protocol>(dynamixel::Protocol::V1, "protocol_version", {
     {"1", dynamixel::Protocol::V1},
     {"2", dynamixel::Protocol::V2}
 }, "the dynamixel protocol version (values: 1, 2)");
+inline auto g_devices         = sargp::Parameter<std::vector<std::string>>({}, "devices", "several usb2dynamixel devices to drive at once, each as device[:baudrate[:protocol_version]] (e.g.: /dev/ttyUSB0:3m:2), defaults to --baudrate and --protocol_version", {}, &listDeviceFiles);
+
+// an entry of --devices, the parts that are not given default to --baudrate and --protocol_version
+struct DeviceSpec {
+	dynamixel::MultiBus::BusConfig config;
+	bool hasBaudrate {false};
+	bool hasProtocol {false};
+};
+auto getDeviceSpecs() -> std::vector<DeviceSpec>;
+// the buses passed by --devices or the single bus given by --device
+auto getBusConfigs() -> std::vector<dynamixel::MultiBus::BusConfig>;
+
+// the timeout given by --timeout or USB2Dynamixel::AutoTimeout if --auto_timeout is set
+auto getTimeout() -> std::chrono::microseconds;
+// apply --latency and --learn_latency to the timing model of usb2dyn
+void configureTiming(dynamixel::USB2Dynamixel& usb2dyn);
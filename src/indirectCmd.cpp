@@ -0,0 +1,90 @@
+#include "usb2dynamixel/IndirectMapping.h"
+#include "commonTasks.h"
+#include "globalOptions.h"
+
+#include <iomanip>
+#include <map>
+
+namespace {
+
+void runIndirect();
+auto indirectCmd = sargp::Command{"indirect", "map registers into the indirect data block of MX_V2/Pro motors and read them through it", runIndirect};
+auto ids         = indirectCmd.Parameter<std::vector<int>>({}, "ids", "the motors to program");
+auto registers   = indirectCmd.Parameter<std::vector<std::string>>({}, "registers", "registers to map, by address or name (e.g.: PRESENT_POSITION PRESENT_CURRENT HARDWARE_ERROR_STATUS)");
+
+using namespace dynamixel;
+
+void runIndirect() {
+	std::vector<MotorID> motors;
+	if (g_id) {
+		motors.push_back(MotorID(*g_id));
+	}
+	for (auto id : *ids) {
+		motors.push_back(MotorID(id));
+	}
+	if (motors.empty()) {
+		throw std::runtime_error("need to specify the target ids");
+	}
+	if (registers->empty()) {
+		throw std::runtime_error("need to specify the registers to map");
+	}
+
+	auto timeout = getTimeout();
+	auto usb2dyn = USB2Dynamixel(*g_baudrate, *g_device, *g_protocolVersion);
+	configureTiming(usb2dyn);
+
+	// every layout gets its own mapping, the registers are at different addresses
+	std::map<LayoutType, std::vector<MotorID>> motorsByLayout;
+	for (auto motor : motors) {
+		auto [layout, modelNumber] = detectMotor(motor, usb2dyn, timeout);
+		if (layout == LayoutType::None) {
+			std::cout << "motor " << int(motor) << " not found\n";
+			continue;
+		}
+		motorsByLayout[layout].push_back(motor);
+	}
+
+	// all mappings are built before any motor is programmed
+	std::map<LayoutType, IndirectMapping> mappings;
+	for (auto const& [layout, layoutMotors] : motorsByLayout) {
+		std::vector<int> addresses;
+		for (auto const& name : *registers) {
+			auto reg = findRegister(layout, name);
+			if (not reg) {
+				throw std::runtime_error("register " + name + " is unknown for layout " + to_string(layout));
+			}
+			addresses.push_back(*reg);
+		}
+		mappings[layout] = buildIndirectMapping(layout, addresses);
+	}
+
+	for (auto const& [layout, layoutMotors] : motorsByLayout) {
+		auto const& mapping = mappings.at(layout);
+		if (mapping.block.romArea) {
+			std::cout << "the indirect addresses of " << to_string(layout) << " are in the eeprom area, torque has to be disabled to program them\n";
+		}
+		programIndirectMapping(usb2dyn, layoutMotors, mapping);
+
+		auto read = prepareIndirectRead(usb2dyn, layoutMotors, mapping);
+		usb2dyn.execute(read, timeout);
+		std::cout << to_string(layout) << ": " << mapping.length << " bytes at register " << mapping.block.dataBlock << " per motor\n";
+		for (std::size_t idx{0}; idx < layoutMotors.size(); ++idx) {
+			std::cout << "motor " << int(layoutMotors[idx]);
+			if (not read.hasReplied(idx)) {
+				std::cout << " did not reply\n";
+				continue;
+			}
+			auto data = read.getData(idx);
+			for (auto const& [reg, length, offset] : mapping.registers) {
+				int64_t value {0};
+				for (std::size_t i{0}; i < length; ++i) {
+					value |= std::to_integer<int64_t>(data[offset + i]) << (8 * i);
+				}
+				std::cout << "  " << reg << ": " << value;
+			}
+			std::cout << "\n";
+		}
+	}
+}
+
+}
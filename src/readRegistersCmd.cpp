@@ -0,0 +1,111 @@
+#include "usb2dynamixel/IndirectMapping.h"
+#include "usb2dynamixel/ReadPlanner.h"
+#include "commonTasks.h"
+#include "globalOptions.h"
+
+#include <map>
+
+namespace {
+
+void runReadRegisters();
+auto readRegistersCmd = sargp::Command{"read_registers", "read a set of registers from several motors with the fewest bytes on the wire", runReadRegisters};
+auto ids              = readRegistersCmd.Parameter<std::vector<int>>({}, "ids", "the motors to read from");
+auto registers        = readRegistersCmd.Parameter<std::vector<std::string>>({}, "registers", "registers to read, by address or name (e.g.: PRESENT_POSITION PRESENT_CURRENT)");
+auto planOnly         = readRegistersCmd.Flag("plan_only", "only print the read plan, do not execute it");
+
+using namespace dynamixel;
+
+void printPlan(ReadPlan const& plan, ReadCostModel const& model, std::size_t fullLength) {
+	for (auto const& [baseRegister, length] : plan.windows) {
+		std::cout << "  window " << baseRegister << " +" << length << "\n";
+	}
+	auto fullTime = std::chrono::duration_cast<std::chrono::microseconds>(model.estimate(plan.motors.size(), fullLength));
+	auto fullBytes = model.requestBytes(plan.motors.size()) + model.replyBytes(plan.motors.size(), fullLength);
+	std::cout << "  " << plan.wireBytes << " bytes, estimated " << std::chrono::duration_cast<std::chrono::microseconds>(plan.estimatedTime).count() << "us"
+	          << " (full layout: " << fullBytes << " bytes, " << fullTime.count() << "us)\n";
+}
+
+void runReadRegisters() {
+	std::vector<MotorID> motors;
+	if (g_id) {
+		motors.push_back(MotorID(*g_id));
+	}
+	for (auto id : *ids) {
+		motors.push_back(MotorID(id));
+	}
+	if (motors.empty()) {
+		throw std::runtime_error("need to specify the target ids");
+	}
+	if (registers->empty()) {
+		throw std::runtime_error("need to specify the registers to read");
+	}
+
+	auto timeout = getTimeout();
+	auto usb2dyn = USB2Dynamixel(*g_baudrate, *g_device, *g_protocolVersion);
+	configureTiming(usb2dyn);
+
+	// registers are at different addresses in every layout, each layout gets its own plan
+	std::map<LayoutType, std::vector<MotorID>> motorsByLayout;
+	for (auto motor : motors) {
+		auto [layout, modelNumber] = detectMotor(motor, usb2dyn, timeout);
+		if (layout == LayoutType::None) {
+			std::cout << "motor " << int(motor) << " not found\n";
+			continue;
+		}
+		if (timeout == USB2Dynamixel::AutoTimeout) {
+			usb2dyn.calibrateReturnDelay(motor, layout, timeout);
+		}
+		motorsByLayout[layout].push_back(motor);
+	}
+
+	for (auto const& [layout, layoutMotors] : motorsByLayout) {
+		std::vector<int> addresses;
+		std::map<int, std::size_t> lengths;
+		std::size_t fullLength {0};
+		meta::forAllLayoutTypes([&, layout=layout](auto const& _info) {
+			using Info = std::decay_t<decltype(_info)>;
+			if (Info::Type != layout) {
+				return;
+			}
+			fullLength = Info::FullLayout::Length;
+			for (auto const& [reg, field] : Info::getInfos()) {
+				lengths[int(reg)] = field.length;
+			}
+		});
+		for (auto const& name : *registers) {
+			auto reg = findRegister(layout, name);
+			if (not reg or lengths.count(*reg) == 0) {
+				throw std::runtime_error("register " + name + " is unknown for layout " + to_string(layout));
+			}
+			addresses.push_back(*reg);
+		}
+
+		auto plan = planRead(usb2dyn, layout, layoutMotors, addresses);
+		std::cout << to_string(layout) << ":\n";
+		printPlan(plan, makeCostModel(usb2dyn, layoutMotors), fullLength);
+		if (planOnly) {
+			continue;
+		}
+
+		auto read = prepareRead(usb2dyn, std::move(plan));
+		execute(usb2dyn, read, timeout);
+		for (std::size_t idx{0}; idx < layoutMotors.size(); ++idx) {
+			std::cout << "motor " << int(layoutMotors[idx]);
+			for (auto reg : addresses) {
+				auto data = read.get(idx, reg, lengths.at(reg));
+				if (not data) {
+					std::cout << "  " << reg << ": -";
+					continue;
+				}
+				int64_t value {0};
+				for (std::size_t i{0}; i < data->size(); ++i) {
+					value |= std::to_integer<int64_t>((*data)[i]) << (8 * i);
+				}
+				std::cout << "  " << reg << ": " << value;
+			}
+			std::cout << "\n";
+		}
+	}
+}
+
+}
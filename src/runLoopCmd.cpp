@@ -0,0 +1,113 @@
+#include "usb2dynamixel/USB2Dynamixel.h"
+#include "globalOptions.h"
+#include "cycleScheduler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <iterator>
+#include <optional>
+#include <thread>
+
+namespace {
+
+void runLoop();
+auto runLoopCmd    = sargp::Command{"run_loop", "run a read/write cycle on a set of motors at a fixed rate and report its timing", runLoop};
+auto rate          = runLoopCmd.Parameter<int>(500, "rate", "cycles per second");
+auto ids           = runLoopCmd.Parameter<std::vector<int>>({}, "ids", "the motors to read from and write to (use --devices to spread them over several buses)");
+auto readRegister  = runLoopCmd.Parameter<int>(0, "read_register", "first register to read every cycle");
+auto readCount     = runLoopCmd.Parameter<int>(2, "read_count", "amount of registers to read every cycle");
+auto writeRegister = runLoopCmd.Parameter<int>(0, "write_register", "register to sync write every cycle");
+auto writeValues   = runLoopCmd.Parameter<std::vector<uint8_t>>({}, "write_values", "values to sync write to write_register every cycle");
+
+using namespace dynamixel;
+
+std::atomic<bool> terminateFlag {false};
+
+void runLoop() {
+	std::vector<MotorID> motors;
+	if (g_id) {
+		motors.push_back(MotorID(*g_id));
+	}
+	for (auto id : *ids) {
+		motors.push_back(MotorID(id));
+	}
+	if (motors.empty()) {
+		throw std::runtime_error("need to specify the target ids");
+	}
+	if (*rate <= 0) {
+		throw std::runtime_error("rate must be positive");
+	}
+
+	auto timeout = getTimeout();
+	auto buses = MultiBus{getBusConfigs()};
+	buses.forEachBus([](std::size_t, USB2Dynamixel& usb2dyn) {
+		configureTiming(usb2dyn);
+	});
+	if (buses.size() == 1) {
+		for (auto id : motors) {
+			buses.assign(id, 0);
+		}
+	} else {
+		// find out which motor is attached to which bus
+		buses.scan(motors, timeout);
+		for (auto id : motors) {
+			auto busIdx = buses.getBusOf(id);
+			if (busIdx) {
+				std::cout << "motor " << int(id) << " on " << buses.getConfig(*busIdx).device << "\n";
+			} else {
+				std::cout << "motor " << int(id) << " not found on any bus\n";
+			}
+		}
+	}
+
+	// requests are built once, every cycle only sends them and collects the replies
+	auto preparedRead = buses.prepareSyncRead(motors, *readRegister, *readCount);
+	std::optional<MultiBus::PreparedSyncWrite> preparedWrite;
+	if (writeValues) {
+		Parameter txBuf;
+		for (auto x : *writeValues) {
+			txBuf.push_back(std::byte{x});
+		}
+		std::vector<MotorID> writeMotors;
+		std::copy_if(begin(motors), end(motors), std::back_inserter(writeMotors), [&](MotorID id) { return buses.getBusOf(id).has_value(); });
+		if (not writeMotors.empty()) {
+			preparedWrite = buses.prepareSyncWrite(writeMotors, *writeRegister, txBuf.size());
+			for (std::size_t idx{0}; idx < writeMotors.size(); ++idx) {
+				preparedWrite->set(idx, ByteSpan{txBuf.data(), txBuf.size()});
+			}
+		}
+	}
+
+	int64_t transactions {0};
+	int64_t missingReplies {0};
+
+	// all buses run their part of the cycle in parallel
+	auto scheduler = CycleScheduler{std::chrono::nanoseconds{1'000'000'000 / *rate}, [&] {
+		missingReplies += motors.size() - buses.execute(preparedRead, timeout);
+		transactions += motors.size();
+		if (preparedWrite) {
+			buses.execute(*preparedWrite);
+		}
+	}};
+
+	auto sigHandler = [](int){ terminateFlag = true; };
+	std::signal(SIGINT, sigHandler);
+
+	// the signal handler cannot stop the scheduler itself
+	std::thread stopper([&] {
+		while (not terminateFlag) {
+			std::this_thread::sleep_for(std::chrono::milliseconds{50});
+		}
+		scheduler.stop();
+	});
+
+	std::cout << "running " << motors.size() << " motors on " << buses.size() << " buses at " << *rate << "Hz, press ctrl+c to stop\n";
+	scheduler.run();
+	stopper.join();
+
+	scheduler.printStats(std::cout);
+	std::cout << missingReplies << "/" << transactions << " replies missing\n";
+}
+
+}
@@ -26,7 +26,8 @@ void runSetAngle() {
 	}
 
 	auto usb2dyn = dynamixel::USB2Dynamixel(*g_baudrate, *g_device, *g_protocolVersion);
-	auto [timeoutFlag, motorID, errorCode, layout] = usb2dyn.read<dynamixel::mx_v1::Register::MODEL_NUMBER, 2>(dynamixel::MotorID(g_id), std::chrono::microseconds{g_timeout});
+	configureTiming(usb2dyn);
+	auto [timeoutFlag, motorID, errorCode, layout] = usb2dyn.read<dynamixel::mx_v1::Register::MODEL_NUMBER, 2>(dynamixel::MotorID(g_id), getTimeout());
 	if (timeoutFlag) {
 		std::cout << "the specified motor is not present" << std::endl;
 		exit(-1);
@@ -53,12 +54,32 @@ auto setRegisterCmd = sargp::Command{"set_register", "set registers of a motor",
 auto reg            = setRegisterCmd.Parameter<int>(0, "register", "register to write to");
 auto values         = setRegisterCmd.Parameter<std::vector<uint8_t>>({}, "values", "values to write to the register");
 auto ids            = setRegisterCmd.Parameter<std::vector<int>>({}, "ids", "use this if you want to set multiple devices at once");
+auto staged         = setRegisterCmd.Flag("staged", "stage the writes with REG_WRITE and apply them on all motors at once with a single ACTION");
 
 void runSetRegister() {
 	if (not g_id and not ids) throw std::runtime_error("need to specify the target g_id!");
 	if (not reg) throw std::runtime_error("target register has to be specified!");
 	if (not values) throw std::runtime_error("values to be written to the register have to be specified!");
 
+	if (staged) {
+		dynamixel::Parameter txBuf;
+		for (auto x : values.get()) {
+			txBuf.push_back(std::byte{x});
+		}
+		std::vector<std::tuple<dynamixel::MotorID, int, dynamixel::Parameter>> writes;
+		if (g_id) {
+			writes.emplace_back(g_id, int(reg), txBuf);
+		}
+		for (auto id : ids.get()) {
+			writes.emplace_back(id, int(reg), txBuf);
+		}
+		auto usb2dyn = dynamixel::USB2Dynamixel(g_baudrate, g_device.get(), dynamixel::Protocol(g_protocolVersion.get()));
+		auto skew = usb2dyn.staged_write(writes);
+		std::cout << "staged register " << reg << " on " << writes.size() << " motors, ACTION was transmitted ";
+		std::cout << std::chrono::duration_cast<std::chrono::microseconds>(skew).count() << "us after the first REG_WRITE\n";
+		return;
+	}
+
 	auto f = [&](int id) {
 		std::cout << "set register " << reg << " of motor " << id << " to";
 		for (uint8_t v : std::vector<uint8_t>(values)) {
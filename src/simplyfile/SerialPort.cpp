@@ -45,15 +45,14 @@ SerialPort::SerialPort(std::string const& name, int baudrate)
 	if (0 > fcntl(iFace, F_SETFL, FNDELAY)) {
 		throw std::runtime_error("F_SETFL " +std::string(strerror(errno)));
 	}
+	// pseudo terminals (e.g. a simulated bus) have no serial_struct, low latency mode is not needed there
 	struct serial_struct serial;
 	bzero(&serial, sizeof(serial));
-	if (0 > ioctl(iFace, TIOCGSERIAL, &serial)) {
-		throw std::runtime_error("TIOCGSERIAL " +std::string(strerror(errno)));
-	}
-
-	serial.flags |= ASYNC_LOW_LATENCY;  /* enable low latency  */
-	if (0 > ioctl(iFace, TIOCSSERIAL, &serial)) {
-		std::cout << "cannot do TIOCSSERIAL on " << name << " "  << strerror(errno) << std::endl;
+	if (0 <= ioctl(iFace, TIOCGSERIAL, &serial)) {
+		serial.flags |= ASYNC_LOW_LATENCY;  /* enable low latency  */
+		if (0 > ioctl(iFace, TIOCSSERIAL, &serial)) {
+			std::cout << "cannot do TIOCSSERIAL on " << name << " "  << strerror(errno) << std::endl;
+		}
 	}
 
 	struct termios2 options;
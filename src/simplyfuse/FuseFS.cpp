@@ -6,13 +6,20 @@
 
 #include <stdexcept>
 #include <array>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <map>
 #include <mutex>
+#include <optional>
+#include <thread>
 #include <cstring>
 #include <iostream>
 #include <vector>
 #include <algorithm>
 
+#include <poll.h>
+
 #include <filesystem>
 
 namespace simplyfuse {
@@ -43,12 +50,77 @@ void destroyNode(Node* node) {
 	parent->children.erase(node->name);
 }
 
+// a request as received from the kernel
+struct Request {
+	std::vector<char> buffer;
+	struct fuse_chan* channel {nullptr};
+};
+
+// the header in front of every request (struct fuse_in_header of linux/fuse.h)
+struct RequestHeader {
+	uint32_t length;
+	uint32_t opcode;
+	uint64_t unique;
+	uint64_t nodeid;
+	uint32_t uid;
+	uint32_t gid;
+	uint32_t pid;
+	uint32_t padding;
+};
+constexpr uint32_t opcodeRead  {15};
+constexpr uint32_t opcodeWrite {16};
+
+// reads and writes may take long (they end up in onRead and onWrite), everything else is answered right away
+bool isIORequest(Request const& request) {
+	RequestHeader header;
+	if (request.buffer.size() < sizeof(header)) {
+		return false;
+	}
+	std::memcpy(&header, request.buffer.data(), sizeof(header));
+	return header.opcode == opcodeRead or header.opcode == opcodeWrite;
+}
+
+struct RequestQueue {
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::deque<Request> requests;
+	bool closed {false};
+
+	void push(Request request) {
+		{
+			std::lock_guard lock{mutex};
+			requests.emplace_back(std::move(request));
+		}
+		cv.notify_one();
+	}
+	// blocks until there is a request, nullopt if the queue was closed
+	auto pop() -> std::optional<Request> {
+		std::unique_lock lock{mutex};
+		cv.wait(lock, [&]{ return closed or not requests.empty(); });
+		if (requests.empty()) {
+			return std::nullopt;
+		}
+		auto request = std::move(requests.front());
+		requests.pop_front();
+		return request;
+	}
+	void close() {
+		{
+			std::lock_guard lock{mutex};
+			closed = true;
+		}
+		cv.notify_all();
+	}
+};
+
 static int getattr_callback(const char *path, struct stat *stbuf);
 static int readdir_callback(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi);
 static int open_callback(const char *path, struct fuse_file_info *fi);
 static int read_callback(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi);
 static int write_callback(const char *path, const char *buf, size_t size, off_t offset, struct fuse_file_info *fi);
 static int truncate_callback(const char *path, off_t offset);
+static int release_callback(const char *path, struct fuse_file_info *fi);
+static int poll_callback(const char *path, struct fuse_file_info *fi, struct fuse_pollhandle *ph, unsigned *reventsp);
 
 }
 
@@ -67,6 +139,58 @@ struct FuseFS::Pimpl {
 
 	bool tearDownMountPoint {false};
 
+	// an opened file, identified by fuse_file_info::fh
+	struct OpenFile {
+		FuseFile* file {nullptr};
+		uint64_t seenChanges {0};                     // changes of file when it was opened or last read from offset 0
+		struct fuse_pollhandle* pollHandle {nullptr}; // somebody waits for a change
+	};
+	std::mutex pollMutex;
+	std::map<uint64_t, OpenFile> openFiles;
+	uint64_t nextHandle {0};
+
+	std::atomic<bool> stopping {false};
+	std::thread dispatcher;
+	std::vector<std::thread> workers;
+	RequestQueue metaQueue;
+	RequestQueue ioQueue;
+
+	void dispatch() {
+		auto session = fuse_get_session(fuse);
+		std::vector<char> buffer(fuse_chan_bufsize(channel));
+		while (not stopping) {
+			// poll with a timeout so that stopping is noticed
+			struct pollfd pfd {fuseFD, POLLIN, 0};
+			if (::poll(&pfd, 1, 100) <= 0) {
+				continue;
+			}
+			struct fuse_chan* ch = channel;
+			int res = fuse_chan_recv(&ch, buffer.data(), buffer.size());
+			if (res == 0 or fuse_session_exited(session)) {
+				break;
+			}
+			if (res < 0) {
+				// interrupted or the request was aborted by the kernel
+				continue;
+			}
+			Request request {{buffer.data(), buffer.data() + res}, ch};
+			if (isIORequest(request)) {
+				ioQueue.push(std::move(request));
+			} else {
+				metaQueue.push(std::move(request));
+			}
+		}
+		metaQueue.close();
+		ioQueue.close();
+	}
+
+	void work(RequestQueue& queue) {
+		auto session = fuse_get_session(fuse);
+		while (auto request = queue.pop()) {
+			fuse_session_process(session, request->buffer.data(), request->buffer.size(), request->channel);
+		}
+	}
+
 	Node* getNode(std::filesystem::path const& path) {
 		if (not path.is_absolute()) {
 			throw InvalidPathError("path must be absolute");
@@ -149,12 +273,20 @@ FuseFS::FuseFS(std::filesystem::path const& mountPoint) :
 	fuse_operations.write = write_callback;
 	fuse_operations.readdir = readdir_callback;
 	fuse_operations.truncate = truncate_callback;
+	fuse_operations.release = release_callback;
+	fuse_operations.poll = poll_callback;
 	pimpl->fuse = fuse_new(pimpl->channel, nullptr, &fuse_operations,
 			sizeof(fuse_operations), this);
 	pimpl->fuseFD = fuse_chan_fd(pimpl->channel);
 }
 
 FuseFS::~FuseFS() {
+	stopWorkers();
+	for (auto& [handle, openFile] : pimpl->openFiles) {
+		if (openFile.pollHandle) {
+			fuse_pollhandle_destroy(openFile.pollHandle);
+		}
+	}
 	fuse_unmount(pimpl->mountPoint.c_str(), pimpl->channel);
 	fuse_destroy(pimpl->fuse);
 
@@ -173,6 +305,51 @@ void FuseFS::loop() {
 	}
 }
 
+void FuseFS::startWorkers(std::size_t ioWorkers) {
+	if (pimpl->dispatcher.joinable()) {
+		throw std::logic_error("the workers are already running");
+	}
+	ioWorkers = std::max(ioWorkers, std::size_t{1});
+	pimpl->stopping = false;
+	pimpl->metaQueue.closed = false;
+	pimpl->ioQueue.closed = false;
+	pimpl->workers.emplace_back([this]{ pimpl->work(pimpl->metaQueue); });
+	for (std::size_t i{0}; i < ioWorkers; ++i) {
+		pimpl->workers.emplace_back([this]{ pimpl->work(pimpl->ioQueue); });
+	}
+	pimpl->dispatcher = std::thread([this]{ pimpl->dispatch(); });
+}
+
+void FuseFS::stopWorkers() {
+	if (not pimpl->dispatcher.joinable()) {
+		return;
+	}
+	pimpl->stopping = true;
+	pimpl->dispatcher.join();
+	for (auto& worker : pimpl->workers) {
+		worker.join();
+	}
+	pimpl->workers.clear();
+}
+
+void FuseFS::notifyChanged(FuseFile& file) {
+	std::lock_guard lock{pimpl->pollMutex};
+	for (auto& [handle, openFile] : pimpl->openFiles) {
+		if (openFile.file == &file and openFile.pollHandle) {
+			fuse_notify_poll(openFile.pollHandle);
+			fuse_pollhandle_destroy(openFile.pollHandle);
+			openFile.pollHandle = nullptr;
+		}
+	}
+}
+
+bool FuseFS::hasPollers(FuseFile const& file) const {
+	std::lock_guard lock{pimpl->pollMutex};
+	return std::any_of(pimpl->openFiles.begin(), pimpl->openFiles.end(), [&](auto const& p) {
+		return p.second.file == &file and p.second.pollHandle;
+	});
+}
+
 void FuseFS::registerFile(std::filesystem::path const& _path, FuseFile& file) {
 	std::filesystem::path path = _path.lexically_normal();
 	if (file.fuseFS and file.fuseFS != this) {
@@ -236,6 +413,7 @@ void rmDirHelper(Node* node, FuseFS::Pimpl* pimpl) {
 }
 
 void FuseFS::rmdir(std::filesystem::path const& path) {
+	std::lock_guard lock{pimpl->mutex};
 	Node* node = pimpl->getNode(path);
 	if (node) {
 		rmDirHelper(node, pimpl.get());
@@ -244,16 +422,26 @@ void FuseFS::rmdir(std::filesystem::path const& path) {
 
 namespace {
 
-Node* getNode(std::string const& path) {
+auto getPimpl() -> FuseFS::Pimpl& {
 	struct fuse_context* context = fuse_get_context();
 	FuseFS* fusefs = reinterpret_cast<FuseFS*>(context->private_data);
-	return fusefs->pimpl->getNode(path);
+	return *fusefs->pimpl;
+}
+
+// the file at path, nullptr if there is none
+FuseFile* getFile(std::string const& path) {
+	auto& pimpl = getPimpl();
+	std::lock_guard lock{pimpl.mutex};
+	Node* node = pimpl.getNode(path);
+	return node ? node->file : nullptr;
 }
 
 int getattr_callback(const char *path, struct stat *stbuf) {
 	memset(stbuf, 0, sizeof(*stbuf));
 
-	Node* node = getNode(path);
+	auto& pimpl = getPimpl();
+	std::lock_guard lock{pimpl.mutex};
+	Node* node = pimpl.getNode(path);
 	if (not node) {
 		return -ENOENT;
 	}
@@ -272,7 +460,9 @@ int getattr_callback(const char *path, struct stat *stbuf) {
 }
 
 int readdir_callback(const char *path, void *buf, fuse_fill_dir_t filler, off_t, struct fuse_file_info *) {
-	Node* node = getNode(path);
+	auto& pimpl = getPimpl();
+	std::lock_guard lock{pimpl.mutex};
+	Node* node = pimpl.getNode(path);
 	if (not node) {
 		return -ENOENT;
 	}
@@ -285,36 +475,110 @@ int readdir_callback(const char *path, void *buf, fuse_fill_dir_t filler, off_t,
 	return 0;
 }
 
-int open_callback(const char *path, struct fuse_file_info *) {
-	Node* node = getNode(path);
-	if (not node or not node->file) {
+int open_callback(const char *path, struct fuse_file_info *fi) {
+	FuseFile* file = getFile(path);
+	if (not file) {
 		return -ENOENT;
 	}
-	return node->file->onOpen();
+	int res = file->onOpen();
+	if (res == 0) {
+		auto& pimpl = getPimpl();
+		std::lock_guard lock{pimpl.pollMutex};
+		fi->fh = ++pimpl.nextHandle;
+		pimpl.openFiles[fi->fh] = {file, file->getChanges(), nullptr};
+	}
+	return res;
 }
 
-int read_callback(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *) {
-	Node* node = getNode(path);
-	if (not node or not node->file) {
+int release_callback(const char *path, struct fuse_file_info *fi) {
+	auto& pimpl = getPimpl();
+	FuseFile* opened {nullptr};
+	{
+		std::lock_guard lock{pimpl.pollMutex};
+		auto iter = pimpl.openFiles.find(fi->fh);
+		if (iter == pimpl.openFiles.end()) {
+			return 0;
+		}
+		if (iter->second.pollHandle) {
+			fuse_pollhandle_destroy(iter->second.pollHandle);
+		}
+		opened = iter->second.file;
+		pimpl.openFiles.erase(iter);
+	}
+	// the file might have been unregistered while it was open
+	FuseFile* file = path ? getFile(path) : nullptr;
+	if (not file or file != opened) {
+		return 0;
+	}
+	file->onHandleRelease(fi->fh);
+	return file->onClose();
+}
+
+int read_callback(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi) {
+	FuseFile* file = getFile(path);
+	if (not file) {
 		return -ENOENT;
 	}
-	return node->file->onRead(buf, size, offset);
+	int res = file->onHandleRead(fi->fh, buf, size, offset);
+	if (res >= 0 and offset == 0) {
+		auto& pimpl = getPimpl();
+		std::lock_guard lock{pimpl.pollMutex};
+		auto iter = pimpl.openFiles.find(fi->fh);
+		if (iter != pimpl.openFiles.end() and iter->second.file == file) {
+			iter->second.seenChanges = file->getChanges();
+		}
+	}
+	return res;
+}
+
+// an opened file is readable once it changed after it was opened or last read from offset 0, a poll handle is kept to notify the poller
+int poll_callback(const char *path, struct fuse_file_info *fi, struct fuse_pollhandle *ph, unsigned *reventsp) {
+	FuseFile* file = getFile(path);
+	if (not file) {
+		if (ph) {
+			fuse_pollhandle_destroy(ph);
+		}
+		return -ENOENT;
+	}
+	auto& pimpl = getPimpl();
+	bool waiting {false};
+	{
+		std::lock_guard lock{pimpl.pollMutex};
+		auto iter = pimpl.openFiles.find(fi->fh);
+		*reventsp = POLLOUT | POLLWRNORM;
+		if (iter == pimpl.openFiles.end() or iter->second.file != file or iter->second.seenChanges != file->getChanges()) {
+			*reventsp |= POLLIN | POLLRDNORM | POLLPRI;
+			if (ph) {
+				fuse_pollhandle_destroy(ph);
+			}
+		} else if (ph) {
+			if (iter->second.pollHandle) {
+				fuse_pollhandle_destroy(iter->second.pollHandle);
+			}
+			iter->second.pollHandle = ph;
+			waiting = true;
+		}
+	}
+	if (waiting) {
+		file->onPoll();
+	}
+	return 0;
 }
 
 int write_callback(const char *path, const char *buf, size_t size, off_t offset, struct fuse_file_info *) {
-	Node* node = getNode(path);
-	if (not node or not node->file) {
+	FuseFile* file = getFile(path);
+	if (not file) {
 		return -ENOENT;
 	}
-	return node->file->onWrite(buf, size, offset);
+	return file->onWrite(buf, size, offset);
 }
 
 int truncate_callback(const char *path, off_t offset) {
-	Node* node = getNode(path);
-	if (not node or not node->file) {
+	FuseFile* file = getFile(path);
+	if (not file) {
 		return -ENOENT;
 	}
-	return node->file->onTruncate(offset);
+	return file->onTruncate(offset);
 }
 
 
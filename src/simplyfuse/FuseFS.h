@@ -25,8 +25,19 @@ struct FuseFS {
 	FuseFS(std::filesystem::path const& mountPoint);
 	virtual ~FuseFS();
 
+	// let libfuse handle a single command and return, all file callbacks run on the calling thread
 	void loop();
 
+	/**
+	 * serve requests with worker threads instead of calling loop()
+	 * a dispatcher thread receives the requests. Metadata requests (lookup, getattr, readdir, open, ...) are handled by
+	 * a thread of their own and never queue behind reads and writes, which are spread over ioWorkers threads.
+	 * onRead and onWrite of the registered files may thus be called concurrently.
+	 */
+	void startWorkers(std::size_t ioWorkers);
+	// stop and join the worker threads, the destructor does this as well
+	void stopWorkers();
+
 	int getFD() const;
 
 	// register a file in the file system (a file can be registered multiple times)
@@ -48,6 +59,10 @@ struct FuseFS {
 	struct Pimpl;
 	std::unique_ptr<Pimpl> pimpl;
 
+private:
+	// wake up the pollers of all opened instances of file
+	void notifyChanged(FuseFile& file);
+	bool hasPollers(FuseFile const& file) const;
 };
 
 }
@@ -21,6 +21,25 @@ int FuseFile::getFilePermissions() {
 	return 0666;
 }
 
+int FuseFile::onHandleRead(uint64_t, char* buf, std::size_t size, off_t offset) {
+	return onRead(buf, size, offset);
+}
+
+void FuseFile::onHandleRelease(uint64_t) {}
+
+void FuseFile::onPoll() {}
+
+void FuseFile::notifyChanged() {
+	++changes;
+	if (fuseFS) {
+		fuseFS->notifyChanged(*this);
+	}
+}
+
+bool FuseFile::hasPollers() const {
+	return fuseFS and fuseFS->hasPollers(*this);
+}
+
 int SimpleROFile::onRead(char* buf, std::size_t size, off_t) {
 	size = std::min(size, content.size()+1);
 	std::memcpy(buf, content.data(), size);
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <errno.h>
 #include <iterator>
 #include <unistd.h>
@@ -26,9 +28,25 @@ struct FuseFile {
 
 	virtual int getFilePermissions();
 
+	// a read of the opened file handle (fuse_file_info::fh), e.g. to keep state per open file, forwards to onRead by default
+	virtual int onHandleRead(uint64_t handle, char* buf, std::size_t size, off_t offset);
+	// the opened file handle was closed
+	virtual void onHandleRelease(uint64_t handle);
+
+	// called when somebody starts waiting (poll/select) for a change of this file, e.g. to start watching its source
+	virtual void onPoll();
+
+	// wake up everybody waiting for a change, an opened file is readable (POLLIN) while it changed since it was opened
+	// or last read from offset 0, whichever happened later
+	void notifyChanged();
+	// somebody waits for a change of this file
+	[[nodiscard]] bool hasPollers() const;
+	[[nodiscard]] auto getChanges() const -> uint64_t { return changes; }
+
 	friend class FuseFS;
 protected:
 	FuseFS* fuseFS {nullptr};
+	std::atomic<uint64_t> changes {0}; // number of calls of notifyChanged
 };
 
 struct SimpleROFile : FuseFile {
@@ -0,0 +1,86 @@
+#include "usb2dynamixel/BusSimulator.h"
+#include "globalOptions.h"
+
+#include <atomic>
+#include <csignal>
+#include <filesystem>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+void runSimulate();
+auto simulateCmd  = sargp::Command{"simulate", "simulate a dynamixel bus on a pseudo terminal (use the printed device with --device)", runSimulate};
+auto layouts      = simulateCmd.Parameter<std::vector<std::string>>({}, "layouts", "layouts of the simulated motors (MX_V1, MX_V2, Pro, XL320, AX), defaults to the layouts that speak --protocol_version");
+auto count        = simulateCmd.Parameter<int>(2, "count", "number of simulated motors per layout");
+auto firstID      = simulateCmd.Parameter<int>(1, "first_id", "id of the first simulated motor, the others follow consecutively");
+auto replyLatency = simulateCmd.Parameter<int>(0, "reply_latency", "delay of every status packet in us");
+auto jitter       = simulateCmd.Parameter<int>(0, "jitter", "status packets are split and the second part is delayed by up to this many us");
+auto corruption   = simulateCmd.Parameter<double>(0., "corruption", "probability that a status packet has a flipped bit");
+auto seed         = simulateCmd.Parameter<unsigned>(0, "seed", "seed of the random number generator for jitter and corruption");
+auto link         = simulateCmd.Parameter<std::string>("", "link", "create a symlink with this name to the simulated device");
+
+using namespace dynamixel;
+
+std::atomic<bool> terminateFlag {false};
+
+auto parseLayout(std::string const& name) -> LayoutType {
+	for (auto layout : {LayoutType::MX_V1, LayoutType::MX_V2, LayoutType::Pro, LayoutType::XL320, LayoutType::AX}) {
+		if (to_string(layout) == name) {
+			return layout;
+		}
+	}
+	throw std::runtime_error("unknown layout " + name);
+}
+
+void runSimulate() {
+	auto protocol = *g_protocolVersion;
+	std::vector<LayoutType> simulatedLayouts;
+	if (layouts) {
+		for (auto const& name : *layouts) {
+			simulatedLayouts.push_back(parseLayout(name));
+		}
+	} else if (protocol == Protocol::V1) {
+		simulatedLayouts = {LayoutType::MX_V1, LayoutType::AX};
+	} else {
+		simulatedLayouts = {LayoutType::MX_V2, LayoutType::XL320, LayoutType::Pro};
+	}
+
+	auto simulator = BusSimulator{{protocol, std::chrono::microseconds{*replyLatency}, std::chrono::microseconds{*jitter}, *corruption, *seed}};
+	MotorID nextID = *firstID;
+	for (auto layout : simulatedLayouts) {
+		auto id = nextID;
+		nextID = simulator.addMotors(layout, *count, nextID);
+		std::cout << "motors " << int(id) << "-" << int(nextID)-1 << ": " << to_string(layout) << "\n";
+	}
+
+	auto ptyPath    = simulator.getDevicePath();
+	auto devicePath = ptyPath;
+	if (link) {
+		// only a stale link (e.g. of a previous simulator) is replaced, never a real file
+		auto status = std::filesystem::symlink_status(*link);
+		if (std::filesystem::exists(status) and not std::filesystem::is_symlink(status)) {
+			throw std::runtime_error(*link + " exists and is not a symlink");
+		}
+		std::filesystem::remove(*link);
+		std::filesystem::create_symlink(ptyPath, *link);
+		devicePath = *link;
+	}
+	std::cout << "simulating protocol version " << int(protocol) << " on " << devicePath << ", press ctrl+c to stop\n" << std::flush;
+
+	std::signal(SIGINT, [](int){ terminateFlag = true; });
+	simulator.start();
+	while (not terminateFlag) {
+		std::this_thread::sleep_for(std::chrono::milliseconds{50});
+	}
+	simulator.stop();
+
+	// the link is left alone if somebody replaced it meanwhile
+	if (link and std::filesystem::is_symlink(*link) and std::filesystem::read_symlink(*link) == ptyPath) {
+		std::filesystem::remove(*link);
+	}
+	auto stats = simulator.getStats();
+	std::cout << stats.packets << " packets received, " << stats.replies << " replies sent (" << stats.corrupted << " corrupted)\n";
+}
+
+}
@@ -0,0 +1,426 @@
+#include "BusSimulator.h"
+#include "IndirectMapping.h"
+#include "MotorMetaInfo.h"
+#include "ProtocolV1.h"
+#include "ProtocolV2.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace dynamixel {
+
+namespace {
+
+// status packet error flags for a request the motor cannot serve
+constexpr uint8_t rangeErrorV1       = uint8_t(ErrorCode::Range);
+constexpr uint8_t instructionErrorV1 = uint8_t(ErrorCode::Instruction);
+constexpr uint8_t accessErrorV2      = 0x07;
+constexpr uint8_t instructionErrorV2 = 0x02;
+
+// control table of a model filled with the default value of every register
+auto buildControlTable(uint16_t modelNumber, MotorID id) -> std::optional<std::tuple<LayoutType, std::vector<std::byte>>> {
+	std::optional<std::tuple<LayoutType, std::vector<std::byte>>> result;
+	meta::forAllLayoutTypes([&](auto const& _info) {
+		using Info     = std::decay_t<decltype(_info)>;
+		using Register = typename std::decay_t<decltype(Info::getInfos())>::key_type;
+		if (result) {
+			return;
+		}
+		auto const& defaults = Info::getDefaults();
+		auto iter = std::find_if(begin(defaults), end(defaults), [&](auto const& d) { return d.second.modelNumber == modelNumber; });
+		if (iter == end(defaults)) {
+			return;
+		}
+		auto const& defaultLayout = iter->second.defaultLayout;
+		// registers beyond the full layout (e.g. the indirect blocks of MX_V2) are part of the table as well
+		auto tableSize = int(Info::FullLayout::BaseRegister) + Info::FullLayout::Length;
+		for (auto const& [reg, field] : Info::getInfos()) {
+			tableSize = std::max(tableSize, std::size_t(int(reg) + field.length));
+		}
+		std::vector<std::byte> table(tableSize);
+		auto set = [&](int reg, std::size_t length, uint32_t value) {
+			for (std::size_t i{0}; i < length and reg + i < table.size(); ++i) {
+				table[reg + i] = std::byte((value >> (8*i)) & 0xff);
+			}
+		};
+		for (auto const& [reg, field] : Info::getInfos()) {
+			auto defaultIter = defaultLayout.find(reg);
+			if (defaultIter != defaultLayout.end()) {
+				set(int(reg), field.length, uint32_t(std::get<0>(defaultIter->second).value_or(0)));
+			}
+		}
+		set(int(Register::MODEL_NUMBER), 2, modelNumber);
+		set(int(Register::ID), 1, id);
+		result = std::make_tuple(Info::Type, std::move(table));
+	});
+	return result;
+}
+
+// a byte of an indirect data block stands for the register its indirect address points to
+auto resolveIndirect(LayoutType layout, std::vector<std::byte> const& table, int reg) -> int {
+	for (auto const& block : getIndirectBlocks(layout)) {
+		if (reg < block.dataBlock or reg >= block.dataBlock + int(block.capacity)) {
+			continue;
+		}
+		auto entry  = block.addressBlock + 2 * (reg - block.dataBlock);
+		auto target = std::to_integer<int>(table[entry]) | (std::to_integer<int>(table[entry + 1]) << 8);
+		return target < int(table.size()) ? target : reg;
+	}
+	return reg;
+}
+
+}
+
+BusSimulator::BusSimulator(Options const& options)
+	: mOptions{options}
+	, mRandom{options.seed}
+{
+	if (options.protocol == Protocol::V1) {
+		mProtocol = std::make_unique<ProtocolV1>();
+	} else {
+		mProtocol = std::make_unique<ProtocolV2>();
+	}
+
+	mMaster = ::posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if (not mMaster.valid()) {
+		throw std::runtime_error("cannot open a pseudo terminal: " + std::string(strerror(errno)));
+	}
+	if (::grantpt(mMaster) != 0 or ::unlockpt(mMaster) != 0) {
+		throw std::runtime_error("cannot unlock the pseudo terminal: " + std::string(strerror(errno)));
+	}
+	char name[256];
+	if (::ptsname_r(mMaster, name, sizeof(name)) != 0) {
+		throw std::runtime_error("cannot get the name of the pseudo terminal: " + std::string(strerror(errno)));
+	}
+	mDevicePath = name;
+
+	mSlave = ::open(name, O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if (not mSlave.valid()) {
+		throw std::runtime_error("cannot open " + mDevicePath + ": " + std::string(strerror(errno)));
+	}
+	// no echo and no line editing, the bus is binary
+	struct termios tio;
+	if (::tcgetattr(mSlave, &tio) == 0) {
+		::cfmakeraw(&tio);
+		::tcsetattr(mSlave, TCSANOW, &tio);
+	}
+
+	mEpoll.addFD(mMaster, [this](int) { onReadable(); }, EPOLLIN, "bus_simulator");
+}
+
+BusSimulator::~BusSimulator() {
+	stop();
+}
+
+void BusSimulator::addMotor(MotorID id, uint16_t modelNumber) {
+	if (id >= BroadcastID) {
+		throw std::runtime_error("invalid id for a simulated motor: " + std::to_string(int(id)));
+	}
+	if (mMotors.count(id) > 0) {
+		throw std::runtime_error("simulated motor " + std::to_string(int(id)) + " already exists");
+	}
+	auto table = buildControlTable(modelNumber, id);
+	if (not table) {
+		throw std::runtime_error("cannot simulate unknown model " + std::to_string(modelNumber));
+	}
+	auto& [layout, controlTable] = *table;
+	mMotors.emplace(id, Motor{modelNumber, layout, std::move(controlTable), std::nullopt});
+}
+
+auto BusSimulator::addMotors(LayoutType layout, int count, MotorID firstID) -> MotorID {
+	std::optional<uint16_t> modelNumber;
+	meta::forAllLayoutTypes([&](auto const& _info) {
+		using Info = std::decay_t<decltype(_info)>;
+		auto const& defaults = Info::getDefaults();
+		if (Info::Type == layout and not defaults.empty()) {
+			modelNumber = defaults.begin()->second.modelNumber;
+		}
+	});
+	if (not modelNumber) {
+		throw std::runtime_error("no model known for layout " + to_string(layout));
+	}
+	int id = firstID;
+	for (int i{0}; i < count; ++i, ++id) {
+		addMotor(MotorID(id), *modelNumber);
+	}
+	return MotorID(id);
+}
+
+void BusSimulator::start() {
+	if (mThread.joinable()) {
+		return;
+	}
+	mStop = false;
+	mThread = std::thread([this] {
+		while (not mStop) {
+			mEpoll.work(1, 100);
+		}
+	});
+}
+
+void BusSimulator::stop() {
+	mStop = true;
+	mEpoll.wakeup();
+	if (mThread.joinable()) {
+		mThread.join();
+	}
+}
+
+auto BusSimulator::getControlTable(MotorID id) -> std::vector<std::byte>& {
+	auto iter = mMotors.find(id);
+	if (iter == mMotors.end()) {
+		throw std::runtime_error("no simulated motor with id " + std::to_string(int(id)));
+	}
+	return iter->second.controlTable;
+}
+
+auto BusSimulator::getStats() const -> Stats {
+	return Stats{mPackets, mReplies, mCorrupted};
+}
+
+void BusSimulator::onReadable() {
+	mRxBuffer.fill(mMaster);
+	while (auto packet = mProtocol->decodePacket(mRxBuffer)) {
+		++mPackets;
+		handle(*packet);
+	}
+}
+
+auto BusSimulator::readField(std::byte const* ptr) const -> int {
+	if (mOptions.protocol == Protocol::V1) {
+		return std::to_integer<int>(ptr[0]);
+	}
+	return std::to_integer<int>(ptr[0]) | (std::to_integer<int>(ptr[1]) << 8);
+}
+
+auto BusSimulator::readRegisters(Motor const& motor, int baseRegister, std::size_t length) const -> std::optional<Parameter> {
+	if (baseRegister < 0 or baseRegister + length > motor.controlTable.size()) {
+		return std::nullopt;
+	}
+	Parameter data(length);
+	for (std::size_t i{0}; i < length; ++i) {
+		data[i] = motor.controlTable[resolveIndirect(motor.layout, motor.controlTable, baseRegister + int(i))];
+	}
+	return data;
+}
+
+bool BusSimulator::writeRegisters(Motor& motor, int baseRegister, std::byte const* data, std::size_t length) {
+	if (baseRegister < 0 or baseRegister + length > motor.controlTable.size()) {
+		return false;
+	}
+	for (std::size_t i{0}; i < length; ++i) {
+		motor.controlTable[resolveIndirect(motor.layout, motor.controlTable, baseRegister + int(i))] = data[i];
+	}
+	return true;
+}
+
+void BusSimulator::handle(Packet const& packet) {
+	auto const& params = packet.parameters;
+	bool broadcast = packet.motorID == BroadcastID;
+	auto fs = fieldSize();
+	bool v1 = mOptions.protocol == Protocol::V1;
+	uint8_t rangeError = v1 ? rangeErrorV1 : accessErrorV2;
+
+	auto motorIter = mMotors.find(packet.motorID);
+	if (not broadcast and motorIter == mMotors.end()) {
+		return;
+	}
+
+	switch (Instruction(packet.instruction)) {
+	case Instruction::PING: {
+		// a broadcast ping is only answered by protocol v2 motors, one after another
+		for (auto& [id, motor] : mMotors) {
+			if ((broadcast and not v1) or id == packet.motorID) {
+				if (v1) {
+					reply(id, 0, {});
+				} else {
+					std::array<std::byte, 3> info {std::byte(motor.modelNumber & 0xff), std::byte(motor.modelNumber >> 8), std::byte{0}};
+					reply(id, 0, ByteSpan{info.data(), info.size()});
+				}
+			}
+		}
+	} break;
+	case Instruction::READ: {
+		if (broadcast or params.size() != 2 * fs) {
+			break;
+		}
+		auto data = readRegisters(motorIter->second, readField(params.data()), readField(params.data() + fs));
+		if (data) {
+			reply(packet.motorID, 0, ByteSpan{data->data(), data->size()});
+		} else {
+			reply(packet.motorID, rangeError, {});
+		}
+	} break;
+	case Instruction::WRITE:
+	case Instruction::REG_WRITE: {
+		if (params.size() < fs) {
+			break;
+		}
+		auto baseRegister = readField(params.data());
+		for (auto& [id, motor] : mMotors) {
+			if (not broadcast and id != packet.motorID) {
+				continue;
+			}
+			bool valid = true;
+			if (Instruction(packet.instruction) == Instruction::WRITE) {
+				valid = writeRegisters(motor, baseRegister, params.data() + fs, params.size() - fs);
+			} else {
+				motor.registered = std::make_tuple(baseRegister, Parameter(params.begin() + fs, params.end()));
+			}
+			if (not broadcast) {
+				reply(id, valid ? 0 : rangeError, {});
+			}
+		}
+	} break;
+	case Instruction::ACTION: {
+		for (auto& [id, motor] : mMotors) {
+			if (not broadcast and id != packet.motorID) {
+				continue;
+			}
+			if (motor.registered) {
+				auto const& [baseRegister, data] = *motor.registered;
+				writeRegisters(motor, baseRegister, data.data(), data.size());
+				motor.registered.reset();
+			}
+			if (not broadcast) {
+				reply(id, 0, {});
+			}
+		}
+	} break;
+	case Instruction::RESET:
+	case Instruction::REBOOT: {
+		if (not broadcast) {
+			reply(packet.motorID, 0, {});
+		}
+	} break;
+	case Instruction::SYNC_WRITE: {
+		if (params.size() < 2 * fs) {
+			break;
+		}
+		auto baseRegister = readField(params.data());
+		std::size_t length = readField(params.data() + fs);
+		for (auto ptr = params.begin() + 2 * fs; ptr + 1 + length <= params.end(); ptr += 1 + length) {
+			auto iter = mMotors.find(MotorID(*ptr));
+			if (iter != mMotors.end()) {
+				writeRegisters(iter->second, baseRegister, ptr + 1, length);
+			}
+		}
+	} break;
+	case Instruction::SYNC_READ: {
+		if (v1 or params.size() < 2 * fs) {
+			break;
+		}
+		auto baseRegister = readField(params.data());
+		std::size_t length = readField(params.data() + fs);
+		for (auto ptr = params.begin() + 2 * fs; ptr != params.end(); ++ptr) {
+			auto iter = mMotors.find(MotorID(*ptr));
+			if (iter == mMotors.end()) {
+				continue;
+			}
+			auto data = readRegisters(iter->second, baseRegister, length);
+			if (data) {
+				reply(iter->first, 0, ByteSpan{data->data(), data->size()});
+			} else {
+				reply(iter->first, rangeError, {});
+			}
+		}
+	} break;
+	case Instruction::BULK_READ: {
+		// v1: 0x00 [length id address]..., v2: [id address(2) length(2)]...
+		std::size_t entrySize = v1 ? 3 : 5;
+		auto ptr = params.begin() + (v1 ? 1 : 0);
+		for (; ptr + entrySize <= params.end(); ptr += entrySize) {
+			MotorID id     = v1 ? MotorID(ptr[1]) : MotorID(ptr[0]);
+			int baseRegister   = v1 ? readField(ptr + 2) : readField(ptr + 1);
+			std::size_t length = v1 ? readField(ptr) : readField(ptr + 3);
+			auto iter = mMotors.find(id);
+			if (iter == mMotors.end()) {
+				continue;
+			}
+			auto data = readRegisters(iter->second, baseRegister, length);
+			if (data) {
+				reply(id, 0, ByteSpan{data->data(), data->size()});
+			} else {
+				reply(id, rangeError, {});
+			}
+		}
+	} break;
+	case Instruction::BULK_WRITE: {
+		// [id address(2) length(2) data(length)]...
+		for (auto ptr = params.begin(); ptr + 5 <= params.end();) {
+			auto iter = mMotors.find(MotorID(ptr[0]));
+			int baseRegister   = readField(ptr + 1);
+			std::size_t length = readField(ptr + 3);
+			if (ptr + 5 + length > params.end()) {
+				break;
+			}
+			if (iter != mMotors.end()) {
+				writeRegisters(iter->second, baseRegister, ptr + 5, length);
+			}
+			ptr += 5 + length;
+		}
+	} break;
+	default:
+		if (not broadcast) {
+			reply(packet.motorID, v1 ? instructionErrorV1 : instructionErrorV2, {});
+		}
+		break;
+	}
+}
+
+void BusSimulator::reply(MotorID id, uint8_t error, ByteSpan payload) {
+	Parameter packet;
+	if (mOptions.protocol == Protocol::V1) {
+		// protocol v1 transports the error in the instruction field
+		packet = mProtocol->createPacket(id, Instruction(error), Parameter(payload.begin(), payload.end()));
+	} else {
+		Parameter params{std::byte{error}};
+		params.insert(params.end(), payload.begin(), payload.end());
+		packet = mProtocol->createPacket(id, Instruction::STATUS, params);
+	}
+
+	if (mOptions.corruption > 0. and std::bernoulli_distribution{mOptions.corruption}(mRandom)) {
+		auto idx = std::uniform_int_distribution<std::size_t>{0, packet.size()-1}(mRandom);
+		auto bit = std::uniform_int_distribution<int>{0, 7}(mRandom);
+		packet[idx] ^= std::byte(1 << bit);
+		++mCorrupted;
+	}
+	if (mOptions.latency.count() > 0) {
+		std::this_thread::sleep_for(mOptions.latency);
+	}
+
+	// a write that does not fit into the pty (nobody reads the other side) is dropped like bytes on a bus without listener
+	auto send = [&](std::byte const* data, std::size_t size) {
+		while (size > 0) {
+			auto w = ::write(mMaster, data, size);
+			if (w < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				return;
+			}
+			data += w;
+			size -= w;
+		}
+	};
+	if (mOptions.jitter.count() > 0 and packet.size() > 1) {
+		auto split = std::uniform_int_distribution<std::size_t>{1, packet.size()-1}(mRandom);
+		auto delay = std::uniform_int_distribution<int64_t>{0, mOptions.jitter.count()}(mRandom);
+		send(packet.data(), split);
+		std::this_thread::sleep_for(std::chrono::microseconds{delay});
+		send(packet.data() + split, packet.size() - split);
+	} else {
+		send(packet.data(), packet.size());
+	}
+	++mReplies;
+}
+
+}
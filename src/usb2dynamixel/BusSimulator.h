@@ -0,0 +1,103 @@
+#pragma once
+
+#include "USB2Dynamixel.h"
+#include "ProtocolBase.h"
+#include "RxBuffer.h"
+
+#include <simplyfile/Epoll.h>
+#include <simplyfile/FileDescriptor.h>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dynamixel {
+
+/**
+ * a virtual dynamixel bus on a pseudo terminal
+ *
+ * the simulator owns the master side of a pty, the slave side (getDevicePath()) can be opened like any usb2dynamixel device.
+ * Every simulated motor has a control table seeded from the defaults of its model (MotorLayoutInfo<>::getDefaults())
+ * and answers PING, READ, WRITE, REG_WRITE, ACTION, SYNC_READ, SYNC_WRITE, BULK_READ and BULK_WRITE.
+ * Indirect data blocks mirror the registers their indirect addresses point to, like on the real motors.
+ */
+struct BusSimulator {
+	struct Options {
+		Protocol protocol {Protocol::V1};
+		std::chrono::microseconds latency {0}; // delay before every status packet
+		std::chrono::microseconds jitter  {0}; // status packets are split at a random byte and the rest is sent up to jitter later
+		double corruption {0.};                // probability that a bit of a status packet is flipped
+		unsigned seed {0};
+	};
+
+	explicit BusSimulator(Options const& options);
+	~BusSimulator();
+
+	BusSimulator(BusSimulator const&) = delete;
+	auto operator=(BusSimulator const&) -> BusSimulator& = delete;
+
+	[[nodiscard]] auto getDevicePath() const -> std::string const& { return mDevicePath; }
+
+	// add a motor of the given model, throws if the model is unknown or the id is taken
+	void addMotor(MotorID id, uint16_t modelNumber);
+	// add count motors of the first model of layout with consecutive ids starting at firstID, returns the next free id
+	auto addMotors(LayoutType layout, int count, MotorID firstID) -> MotorID;
+
+	// process packets on a background thread until stop() is called or the simulator is destroyed
+	void start();
+	void stop();
+
+	// direct access to the control table of a simulated motor, must not be used while the simulator is running
+	[[nodiscard]] auto getControlTable(MotorID id) -> std::vector<std::byte>&;
+
+	struct Stats {
+		int64_t packets {0};      // instruction packets received
+		int64_t replies {0};      // status packets sent
+		int64_t corrupted {0};    // status packets with a flipped bit
+	};
+	[[nodiscard]] auto getStats() const -> Stats;
+
+private:
+	struct Motor {
+		uint16_t modelNumber;
+		LayoutType layout;
+		std::vector<std::byte> controlTable;
+		std::optional<std::tuple<int, Parameter>> registered; // [baseRegister, data] of a REG_WRITE that waits for an ACTION
+	};
+
+	void onReadable();
+	void handle(Packet const& packet);
+	void reply(MotorID id, uint8_t error, ByteSpan payload);
+	auto readRegisters(Motor const& motor, int baseRegister, std::size_t length) const -> std::optional<Parameter>;
+	bool writeRegisters(Motor& motor, int baseRegister, std::byte const* data, std::size_t length);
+
+	// address and length fields are one byte in protocol v1 and two bytes in protocol v2
+	[[nodiscard]] auto fieldSize() const -> std::size_t { return mOptions.protocol == Protocol::V1 ? 1 : 2; }
+	[[nodiscard]] auto readField(std::byte const* ptr) const -> int;
+
+	Options mOptions;
+	std::unique_ptr<ProtocolBase> mProtocol;
+	simplyfile::FileDescriptor mMaster;
+	simplyfile::FileDescriptor mSlave; // kept open so that the master does not see a hangup while no client is connected
+	std::string mDevicePath;
+
+	RxBuffer mRxBuffer;
+	std::map<MotorID, Motor> mMotors;
+	std::mt19937 mRandom;
+
+	simplyfile::Epoll mEpoll;
+	std::thread mThread;
+	std::atomic<bool> mStop {false};
+
+	std::atomic<int64_t> mPackets {0};
+	std::atomic<int64_t> mReplies {0};
+	std::atomic<int64_t> mCorrupted {0};
+};
+
+}
@@ -0,0 +1,196 @@
+#include "Crc16.h"
+
+#include <array>
+#include <stdexcept>
+#include <string>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define DYNAMIXEL_CRC16_CLMUL
+#include <immintrin.h>
+#endif
+
+namespace dynamixel::crc16 {
+
+namespace {
+
+constexpr std::array<uint16_t, 256> crc_table = {
+	0x0000, 0x8005, 0x800F, 0x000A, 0x801B, 0x001E, 0x0014, 0x8011,
+	0x8033, 0x0036, 0x003C, 0x8039, 0x0028, 0x802D, 0x8027, 0x0022,
+	0x8063, 0x0066, 0x006C, 0x8069, 0x0078, 0x807D, 0x8077, 0x0072,
+	0x0050, 0x8055, 0x805F, 0x005A, 0x804B, 0x004E, 0x0044, 0x8041,
+	0x80C3, 0x00C6, 0x00CC, 0x80C9, 0x00D8, 0x80DD, 0x80D7, 0x00D2,
+	0x00F0, 0x80F5, 0x80FF, 0x00FA, 0x80EB, 0x00EE, 0x00E4, 0x80E1,
+	0x00A0, 0x80A5, 0x80AF, 0x00AA, 0x80BB, 0x00BE, 0x00B4, 0x80B1,
+	0x8093, 0x0096, 0x009C, 0x8099, 0x0088, 0x808D, 0x8087, 0x0082,
+	0x8183, 0x0186, 0x018C, 0x8189, 0x0198, 0x819D, 0x8197, 0x0192,
+	0x01B0, 0x81B5, 0x81BF, 0x01BA, 0x81AB, 0x01AE, 0x01A4, 0x81A1,
+	0x01E0, 0x81E5, 0x81EF, 0x01EA, 0x81FB, 0x01FE, 0x01F4, 0x81F1,
+	0x81D3, 0x01D6, 0x01DC, 0x81D9, 0x01C8, 0x81CD, 0x81C7, 0x01C2,
+	0x0140, 0x8145, 0x814F, 0x014A, 0x815B, 0x015E, 0x0154, 0x8151,
+	0x8173, 0x0176, 0x017C, 0x8179, 0x0168, 0x816D, 0x8167, 0x0162,
+	0x8123, 0x0126, 0x012C, 0x8129, 0x0138, 0x813D, 0x8137, 0x0132,
+	0x0110, 0x8115, 0x811F, 0x011A, 0x810B, 0x010E, 0x0104, 0x8101,
+	0x8303, 0x0306, 0x030C, 0x8309, 0x0318, 0x831D, 0x8317, 0x0312,
+	0x0330, 0x8335, 0x833F, 0x033A, 0x832B, 0x032E, 0x0324, 0x8321,
+	0x0360, 0x8365, 0x836F, 0x036A, 0x837B, 0x037E, 0x0374, 0x8371,
+	0x8353, 0x0356, 0x035C, 0x8359, 0x0348, 0x834D, 0x8347, 0x0342,
+	0x03C0, 0x83C5, 0x83CF, 0x03CA, 0x83DB, 0x03DE, 0x03D4, 0x83D1,
+	0x83F3, 0x03F6, 0x03FC, 0x83F9, 0x03E8, 0x83ED, 0x83E7, 0x03E2,
+	0x83A3, 0x03A6, 0x03AC, 0x83A9, 0x03B8, 0x83BD, 0x83B7, 0x03B2,
+	0x0390, 0x8395, 0x839F, 0x039A, 0x838B, 0x038E, 0x0384, 0x8381,
+	0x0280, 0x8285, 0x828F, 0x028A, 0x829B, 0x029E, 0x0294, 0x8291,
+	0x82B3, 0x02B6, 0x02BC, 0x82B9, 0x02A8, 0x82AD, 0x82A7, 0x02A2,
+	0x82E3, 0x02E6, 0x02EC, 0x82E9, 0x02F8, 0x82FD, 0x82F7, 0x02F2,
+	0x02D0, 0x82D5, 0x82DF, 0x02DA, 0x82CB, 0x02CE, 0x02C4, 0x82C1,
+	0x8243, 0x0246, 0x024C, 0x8249, 0x0258, 0x825D, 0x8257, 0x0252,
+	0x0270, 0x8275, 0x827F, 0x027A, 0x826B, 0x026E, 0x0264, 0x8261,
+	0x0220, 0x8225, 0x822F, 0x022A, 0x823B, 0x023E, 0x0234, 0x8231,
+	0x8213, 0x0216, 0x021C, 0x8219, 0x0208, 0x820D, 0x8207, 0x0202
+};
+
+// slice_tables[k][b] is the crc of the byte b followed by k zero bytes
+constexpr auto makeSliceTables() -> std::array<std::array<uint16_t, 256>, 8> {
+	std::array<std::array<uint16_t, 256>, 8> tables {};
+	tables[0] = crc_table;
+	for (std::size_t k{1}; k < tables.size(); ++k) {
+		for (std::size_t b{0}; b < 256; ++b) {
+			auto prev = tables[k-1][b];
+			tables[k][b] = uint16_t(prev << 8) ^ crc_table[prev >> 8];
+		}
+	}
+	return tables;
+}
+constexpr auto slice_tables = makeSliceTables();
+
+auto computeBytewise(std::byte const* data, std::size_t size, uint16_t crc) -> uint16_t {
+	for (auto end = data + size; data != end; ++data) {
+		uint8_t index = ((crc >> 8) ^ static_cast<uint8_t>(*data)) & 0xff;
+		crc = uint16_t(crc << 8) ^ crc_table[index];
+	}
+	return crc;
+}
+
+auto computeSlice8(std::byte const* data, std::size_t size, uint16_t crc) -> uint16_t {
+	auto const& t = slice_tables;
+	for (; size >= 8; size -= 8, data += 8) {
+		// the crc of the preceding data is xored onto the first two bytes
+		crc = t[7][uint8_t(data[0]) ^ (crc >> 8)]
+		    ^ t[6][uint8_t(data[1]) ^ (crc & 0xff)]
+		    ^ t[5][uint8_t(data[2])]
+		    ^ t[4][uint8_t(data[3])]
+		    ^ t[3][uint8_t(data[4])]
+		    ^ t[2][uint8_t(data[5])]
+		    ^ t[1][uint8_t(data[6])]
+		    ^ t[0][uint8_t(data[7])];
+	}
+	return computeBytewise(data, size, crc);
+}
+
+#ifdef DYNAMIXEL_CRC16_CLMUL
+// x^n mod 0x18005
+constexpr auto xPowMod(unsigned n) -> uint64_t {
+	uint32_t r = 1;
+	for (unsigned i{0}; i < n; ++i) {
+		r <<= 1;
+		if (r & 0x10000) {
+			r ^= 0x18005;
+		}
+	}
+	return r;
+}
+
+/**
+ * the data is treated as a sequence of 128 bit polynomials (the first byte holds the highest coefficients).
+ * A block that is followed by another one is folded onto it: its upper and lower halves are multiplied with
+ * x^192 mod P and x^128 mod P, which leaves a value of at most 79 bits that has the same crc contribution.
+ * The last folded block and the remaining bytes are then finished by the table driven engine.
+ */
+__attribute__((target("pclmul,ssse3")))
+auto computeClmul(std::byte const* data, std::size_t size, uint16_t crc) -> uint16_t {
+	if (size < 32) {
+		return computeSlice8(data, size, crc);
+	}
+	auto const byteReverse = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+	auto const constants   = _mm_set_epi64x(xPowMod(192), xPowMod(128));
+
+	auto acc = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const*>(data)), byteReverse);
+	acc = _mm_xor_si128(acc, _mm_set_epi64x(int64_t(uint64_t(crc) << 48), 0));
+	data += 16;
+	size -= 16;
+	for (; size >= 16; size -= 16, data += 16) {
+		auto next = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const*>(data)), byteReverse);
+		auto high = _mm_clmulepi64_si128(acc, constants, 0x11);
+		auto low  = _mm_clmulepi64_si128(acc, constants, 0x00);
+		acc = _mm_xor_si128(_mm_xor_si128(high, low), next);
+	}
+	alignas(16) std::array<std::byte, 16> folded;
+	_mm_store_si128(reinterpret_cast<__m128i*>(folded.data()), _mm_shuffle_epi8(acc, byteReverse));
+	crc = computeSlice8(folded.data(), folded.size(), 0);
+	return computeSlice8(data, size, crc);
+}
+#endif
+
+auto selectEngine() -> Engine {
+	if (isSupported(Engine::Clmul)) {
+		return Engine::Clmul;
+	}
+	return Engine::Slice8;
+}
+
+}
+
+auto to_string(Engine engine) -> char const* {
+	switch (engine) {
+		case Engine::Bytewise: return "bytewise";
+		case Engine::Slice8:   return "slice8";
+		case Engine::Clmul:    return "clmul";
+	}
+	return "unknown";
+}
+
+bool isSupported(Engine engine) {
+	if (engine != Engine::Clmul) {
+		return true;
+	}
+#ifdef DYNAMIXEL_CRC16_CLMUL
+	static bool const supported = __builtin_cpu_supports("pclmul") and __builtin_cpu_supports("ssse3");
+	return supported;
+#else
+	return false;
+#endif
+}
+
+auto getEngine() -> Engine {
+	static Engine const engine = selectEngine();
+	return engine;
+}
+
+auto compute(std::byte const* data, std::size_t size, uint16_t crc) -> uint16_t {
+	using Func = uint16_t(*)(std::byte const*, std::size_t, uint16_t);
+	static Func const func = [] () -> Func {
+#ifdef DYNAMIXEL_CRC16_CLMUL
+		if (getEngine() == Engine::Clmul) {
+			return computeClmul;
+		}
+#endif
+		return computeSlice8;
+	}();
+	return func(data, size, crc);
+}
+
+auto compute(Engine engine, std::byte const* data, std::size_t size, uint16_t crc) -> uint16_t {
+	if (not isSupported(engine)) {
+		throw std::runtime_error(std::string{"crc16 engine "} + to_string(engine) + " is not supported on this cpu");
+	}
+	switch (engine) {
+		case Engine::Bytewise: return computeBytewise(data, size, crc);
+		case Engine::Slice8:   return computeSlice8(data, size, crc);
+#ifdef DYNAMIXEL_CRC16_CLMUL
+		case Engine::Clmul:    return computeClmul(data, size, crc);
+#endif
+		default: break;
+	}
+	throw std::runtime_error(std::string{"crc16 engine "} + to_string(engine) + " is not supported on this cpu");
+}
+
+}
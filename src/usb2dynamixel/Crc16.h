@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * crc16 as used by protocol v2 (polynomial 0x8005, not reflected, no final xor)
+ *
+ * there are several engines that compute the same checksum:
+ *  - Bytewise: the classic one table lookup per byte
+ *  - Slice8:   eight tables, processes eight bytes per iteration
+ *  - Clmul:    folds 16 bytes per iteration with carry-less multiplications (x86 with pclmulqdq only)
+ * compute() uses the fastest engine that is supported by the cpu it is running on.
+ */
+namespace dynamixel::crc16 {
+
+enum class Engine {
+	Bytewise,
+	Slice8,
+	Clmul,
+};
+
+[[nodiscard]] auto to_string(Engine engine) -> char const*;
+[[nodiscard]] bool isSupported(Engine engine);
+// the engine that is used by compute(data, size, crc)
+[[nodiscard]] auto getEngine() -> Engine;
+
+// crc is the checksum of the preceding data, this allows to compute the checksum of a packet piece by piece
+[[nodiscard]] auto compute(std::byte const* data, std::size_t size, uint16_t crc = 0) -> uint16_t;
+// throws if engine is not supported
+[[nodiscard]] auto compute(Engine engine, std::byte const* data, std::size_t size, uint16_t crc = 0) -> uint16_t;
+
+}
@@ -0,0 +1,148 @@
+#include "IndirectMapping.h"
+
+#include "MotorMetaInfo.h"
+
+#include <algorithm>
+#include <cctype>
+#include <map>
+#include <stdexcept>
+
+namespace dynamixel {
+
+namespace {
+
+template <typename Register>
+auto makeBlock(meta::Layout<Register> const& infos, Register addressBlock, Register dataBlock) -> IndirectBlock {
+	auto const& addresses = infos.at(addressBlock);
+	auto const& data      = infos.at(dataBlock);
+	if (addresses.length != 2 * data.length) {
+		throw std::runtime_error("indirect address block " + std::to_string(int(addressBlock)) + " does not match its data block");
+	}
+	return IndirectBlock{int(addressBlock), int(dataBlock), data.length, addresses.romArea};
+}
+
+// "PRESENT_POSITION", "present position" and "Present Position" are all the same name
+auto normalize(std::string name) -> std::string {
+	for (auto& c : name) {
+		c = c == ' ' ? '_' : char(std::toupper(static_cast<unsigned char>(c)));
+	}
+	return name;
+}
+
+}
+
+auto getIndirectBlocks(LayoutType layout) -> std::vector<IndirectBlock> const& {
+	static auto const blocks = [] {
+		std::map<LayoutType, std::vector<IndirectBlock>> blocks;
+		using MX  = mx_v2::Register;
+		using Pro = pro::Register;
+		blocks[LayoutType::MX_V2] = {
+			makeBlock(mx_v2::MotorLayoutInfo::getInfos(), MX::INDIRECT_ADDRESS_BLOCK1, MX::INDIRECT_DATA_BLOCK1),
+			makeBlock(mx_v2::MotorLayoutInfo::getInfos(), MX::INDIRECT_ADDRESS_BLOCK2, MX::INDIRECT_DATA_BLOCK2),
+		};
+		blocks[LayoutType::Pro] = {
+			makeBlock(pro::MotorLayoutInfo::getInfos(), Pro::INDIRECT_ADDRESS_BLOCK, Pro::INDIRECT_DATA_BLOCK),
+		};
+		return blocks;
+	}();
+	static auto const none = std::vector<IndirectBlock>{};
+	auto iter = blocks.find(layout);
+	return iter == blocks.end() ? none : iter->second;
+}
+
+auto IndirectMapping::getOffset(int reg) const -> std::optional<std::size_t> {
+	for (auto const& [r, l, offset] : registers) {
+		if (r == reg) {
+			return offset;
+		}
+	}
+	return std::nullopt;
+}
+
+auto IndirectMapping::getAddressTable() const -> Parameter {
+	Parameter table;
+	table.reserve(2 * length);
+	for (auto const& [reg, l, offset] : registers) {
+		for (std::size_t i{0}; i < l; ++i) {
+			auto address = reg + int(i);
+			table.push_back(std::byte(address & 0xff));
+			table.push_back(std::byte((address >> 8) & 0xff));
+		}
+	}
+	return table;
+}
+
+auto buildIndirectMapping(LayoutType layout, std::vector<int> const& registers) -> IndirectMapping {
+	auto const& blocks = getIndirectBlocks(layout);
+	if (blocks.empty()) {
+		throw std::runtime_error("layout " + to_string(layout) + " has no indirect addresses");
+	}
+	IndirectMapping mapping;
+	mapping.layout = layout;
+	mapping.block  = blocks.front();
+
+	meta::forAllLayoutTypes([&](auto const& _info) {
+		using Info     = std::decay_t<decltype(_info)>;
+		using Register = typename std::decay_t<decltype(Info::getInfos())>::key_type;
+		if (Info::Type != layout) {
+			return;
+		}
+		auto const& infos = Info::getInfos();
+		for (auto reg : registers) {
+			auto iter = infos.find(Register(reg));
+			if (iter == infos.end()) {
+				throw std::runtime_error("register " + std::to_string(reg) + " is unknown for layout " + to_string(layout));
+			}
+			if (mapping.getOffset(reg)) {
+				throw std::runtime_error("register " + std::to_string(reg) + " is mapped twice");
+			}
+			mapping.registers.emplace_back(reg, iter->second.length, mapping.length);
+			mapping.length += iter->second.length;
+		}
+	});
+	if (mapping.length > mapping.block.capacity) {
+		throw std::runtime_error("registers need " + std::to_string(mapping.length) + " bytes, the indirect block of " + to_string(layout) + " has " + std::to_string(mapping.block.capacity));
+	}
+	return mapping;
+}
+
+auto findRegister(LayoutType layout, std::string const& name) -> std::optional<int> {
+	if (not name.empty() and std::all_of(name.begin(), name.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)); })) {
+		return std::stoi(name);
+	}
+	std::optional<int> result;
+	meta::forAllLayoutTypes([&](auto const& _info) {
+		using Info = std::decay_t<decltype(_info)>;
+		if (Info::Type != layout) {
+			return;
+		}
+		for (auto const& [reg, field] : Info::getInfos()) {
+			if (normalize(field.name) == normalize(name)) {
+				result = int(reg);
+			}
+		}
+	});
+	return result;
+}
+
+void programIndirectMapping(USB2Dynamixel const& usb2dyn, std::vector<MotorID> const& motors, IndirectMapping const& mapping) {
+	auto table = mapping.getAddressTable();
+	std::map<MotorID, Parameter> motorParams;
+	for (auto motor : motors) {
+		motorParams[motor] = table;
+	}
+	usb2dyn.sync_write(motorParams, mapping.block.addressBlock);
+}
+
+auto prepareIndirectRead(USB2Dynamixel const& usb2dyn, std::vector<MotorID> const& motors, IndirectMapping const& mapping) -> PreparedRead {
+	if (usb2dyn.supportsSyncRead()) {
+		return usb2dyn.prepareSyncRead(motors, mapping.block.dataBlock, mapping.length);
+	}
+	std::vector<std::tuple<MotorID, int, std::size_t>> request;
+	for (auto motor : motors) {
+		request.emplace_back(motor, mapping.block.dataBlock, mapping.length);
+	}
+	return usb2dyn.prepareBulkRead(request);
+}
+
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "USB2Dynamixel.h"
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace dynamixel {
+
+/**
+ * indirect addressing maps scattered registers into one contiguous block
+ *
+ * every byte of the indirect data block mirrors the register whose address is stored in the matching entry
+ * (two bytes, little endian) of the indirect address block. After programming the address block a single small
+ * read of the data block returns all registers of interest instead of a read of the full layout.
+ */
+struct IndirectBlock {
+	int addressBlock {0};     // first indirect address register
+	int dataBlock {0};        // first indirect data register
+	std::size_t capacity {0}; // number of bytes that can be mapped
+	bool romArea {false};     // the address block can only be written while torque is off
+};
+
+// the indirect blocks of a layout, empty if the layout has none
+[[nodiscard]] auto getIndirectBlocks(LayoutType layout) -> std::vector<IndirectBlock> const&;
+
+struct IndirectMapping {
+	LayoutType layout {LayoutType::None};
+	IndirectBlock block;
+	std::vector<std::tuple<int, std::size_t, std::size_t>> registers; // [register, length, offset in the data block]
+	std::size_t length {0};                                          // number of mapped bytes
+
+	// offset of register in the data block, nullopt if it is not mapped
+	[[nodiscard]] auto getOffset(int reg) const -> std::optional<std::size_t>;
+	// content of the address block, two bytes for every mapped byte
+	[[nodiscard]] auto getAddressTable() const -> Parameter;
+};
+
+/**
+ * map registers (in the given order) into the first indirect block of layout
+ * throws if the layout has no indirect block, a register is unknown or the registers do not fit
+ */
+[[nodiscard]] auto buildIndirectMapping(LayoutType layout, std::vector<int> const& registers) -> IndirectMapping;
+// look up a register of layout by its address or its name (e.g. "PRESENT_POSITION" or "Present Position")
+[[nodiscard]] auto findRegister(LayoutType layout, std::string const& name) -> std::optional<int>;
+
+// write the address table of mapping to all motors with one sync write
+void programIndirectMapping(USB2Dynamixel const& usb2dyn, std::vector<MotorID> const& motors, IndirectMapping const& mapping);
+// a read of the mapped bytes of all motors, sync read if the bus supports it
+[[nodiscard]] auto prepareIndirectRead(USB2Dynamixel const& usb2dyn, std::vector<MotorID> const& motors, IndirectMapping const& mapping) -> PreparedRead;
+
+}
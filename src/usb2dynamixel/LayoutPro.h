@@ -49,7 +49,7 @@ enum class Register : int {
 	EXTERNAL_PORT_DATA_2   = 628,
 	EXTERNAL_PORT_DATA_3   = 630,
 	EXTERNAL_PORT_DATA_4   = 632,
-	INDIRECT_DATA_BLOCK    = 534,
+	INDIRECT_DATA_BLOCK    = 634,
 	REGISTERED_INSTRUCTION = 890,
 	STATUS_RETURN_LEVEL    = 891,
 	HARDWARE_ERROR_STATUS  = 892,
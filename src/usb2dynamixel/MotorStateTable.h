@@ -0,0 +1,150 @@
+#pragma once
+
+#include "MotorMetaInfo.h"
+#include "MultiBus.h"
+#include "USB2Dynamixel.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace dynamixel {
+
+/**
+ * the latest state of a fixed set of motors of one LayoutType, stored as struct of arrays
+ *
+ * every selected register is a contiguous column with one entry per motor (a row), e.g.
+ *   MotorStateTable<LayoutType::MX_V2, mx_v2::Register::PRESENT_CURRENT, mx_v2::Register::PRESENT_VELOCITY, mx_v2::Register::PRESENT_POSITION>
+ * has three columns of int16_t, int32_t and int32_t. Scanning all positions only touches the position column instead of
+ * striding over full layouts.
+ * The table reads the window [BaseRegister, BaseRegister + Length) that covers all selected registers. A read prepared
+ * by prepareRead is executed every cycle and update() scatters the replies into the columns in place, it does not allocate.
+ * Rows of motors that did not reply keep their previous values and are marked as not valid.
+ */
+template <LayoutType LT, auto... Registers>
+struct MotorStateTable {
+	using Info     = meta::MotorLayoutInfo<LT>;
+	using Register = std::decay_t<decltype(Info::FullLayout::BaseRegister)>;
+	static_assert(sizeof...(Registers) > 0, "need at least one register");
+	static_assert((std::is_same_v<decltype(Registers), Register> and ...), "registers must belong to the layout type");
+
+	template <Register reg>
+	using ValueType = typename LayoutPart<reg>::PartType;
+
+	static constexpr LayoutType Type {LT};
+	static constexpr Register BaseRegister {std::min({Registers...})};
+	static constexpr std::size_t Length {std::max({std::size_t(int(Registers) + sizeof(ValueType<Registers>))...}) - std::size_t(BaseRegister)};
+
+	explicit MotorStateTable(std::vector<MotorID> motors)
+		: mMotors {std::move(motors)}
+		, mColumns {std::vector<ValueType<Registers>>(mMotors.size())...}
+		, mErrorCodes(mMotors.size())
+		, mValid(mMotors.size(), 0)
+	{
+		for (std::size_t row{0}; row < mMotors.size(); ++row) {
+			if (not mRows.emplace(mMotors[row], row).second) {
+				throw std::runtime_error("motor " + std::to_string(int(mMotors[row])) + " is listed twice");
+			}
+		}
+	}
+
+	[[nodiscard]] auto size() const -> std::size_t { return mMotors.size(); }
+	[[nodiscard]] auto getMotors() const -> std::vector<MotorID> const& { return mMotors; }
+	[[nodiscard]] auto getRow(MotorID motor) const -> std::optional<std::size_t> {
+		auto iter = mRows.find(motor);
+		if (iter == mRows.end()) {
+			return std::nullopt;
+		}
+		return iter->second;
+	}
+
+	// the values of register reg of all motors, indexed by row
+	template <Register reg>
+	[[nodiscard]] auto column() const -> std::vector<ValueType<reg>> const& {
+		return std::get<columnIndex<reg>()>(mColumns);
+	}
+	template <Register reg>
+	[[nodiscard]] auto get(MotorID motor) const -> std::optional<ValueType<reg>> {
+		auto row = getRow(motor);
+		if (not row) {
+			return std::nullopt;
+		}
+		return column<reg>()[*row];
+	}
+
+	// valid[row] is 1 if the motor replied to the last update
+	[[nodiscard]] auto getValid() const -> std::vector<uint8_t> const& { return mValid; }
+	[[nodiscard]] auto getErrorCodes() const -> std::vector<ErrorCode> const& { return mErrorCodes; }
+	// number of update() calls so far
+	[[nodiscard]] auto getCycle() const -> uint64_t { return mCycle; }
+
+	// a read of the table window of all motors in row order, sync read if the bus supports it
+	[[nodiscard]] auto prepareRead(USB2Dynamixel const& usb2dyn) const -> PreparedRead {
+		if (usb2dyn.supportsSyncRead()) {
+			return usb2dyn.prepareSyncRead(mMotors, int(BaseRegister), Length);
+		}
+		std::vector<std::tuple<MotorID, int, std::size_t>> request;
+		request.reserve(mMotors.size());
+		for (auto motor : mMotors) {
+			request.emplace_back(motor, int(BaseRegister), Length);
+		}
+		return usb2dyn.prepareBulkRead(request);
+	}
+	[[nodiscard]] auto prepareRead(MultiBus const& buses) const -> MultiBus::PreparedSyncRead {
+		return buses.prepareSyncRead(mMotors, int(BaseRegister), Length);
+	}
+
+	/**
+	 * copy the replies of an executed read into the columns
+	 * read has to be created by prepareRead (PreparedRead or MultiBus::PreparedSyncRead), throws if it does not match
+	 */
+	template <typename PreparedT>
+	void update(PreparedT const& read) {
+		if (read.motors.size() != mMotors.size()) {
+			throw std::runtime_error("prepared read has " + std::to_string(read.motors.size()) + " motors, the table has " + std::to_string(mMotors.size()));
+		}
+		for (std::size_t row{0}; row < mMotors.size(); ++row) {
+			mValid[row] = read.hasReplied(row);
+			if (not mValid[row]) {
+				continue;
+			}
+			mErrorCodes[row] = read.getErrorCode(row);
+			update(row, read.getData(row));
+		}
+		++mCycle;
+	}
+
+	// copy a single reply of the table window into the row
+	void update(std::size_t row, ByteSpan data) {
+		if (data.size() != Length) {
+			throw std::runtime_error("reply has " + std::to_string(data.size()) + " bytes, the table reads " + std::to_string(Length));
+		}
+		(std::memcpy(&std::get<columnIndex<Registers>()>(mColumns)[row], data.data() + (int(Registers) - int(BaseRegister)), sizeof(ValueType<Registers>)), ...);
+	}
+
+private:
+	template <Register reg>
+	static constexpr auto columnIndex() -> std::size_t {
+		constexpr Register registers[] {Registers...};
+		std::size_t idx{0};
+		while (idx < sizeof...(Registers) and registers[idx] != reg) {
+			++idx;
+		}
+		static_assert(((reg == Registers) or ...), "register is not a column of this table");
+		return idx;
+	}
+
+	std::vector<MotorID> mMotors;
+	std::map<MotorID, std::size_t> mRows;
+	std::tuple<std::vector<ValueType<Registers>>...> mColumns;
+	std::vector<ErrorCode> mErrorCodes;
+	std::vector<uint8_t> mValid;
+	uint64_t mCycle {0};
+};
+
+}
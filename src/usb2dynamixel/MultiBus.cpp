@@ -0,0 +1,344 @@
+#include "MultiBus.h"
+
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+namespace dynamixel {
+
+namespace {
+
+// wait for all futures, the first exception is rethrown once every job is done
+// (the jobs reference the stack of the caller, hence none of them may outlive this function)
+void waitAll(std::vector<std::future<void>>& futures) {
+	std::exception_ptr error;
+	for (auto& f : futures) {
+		try {
+			f.get();
+		} catch (...) {
+			if (not error) {
+				error = std::current_exception();
+			}
+		}
+	}
+	if (error) {
+		std::rethrow_exception(error);
+	}
+}
+
+}
+
+void MultiBus::Bus::work() {
+	while (true) {
+		std::packaged_task<void()> job;
+		{
+			std::unique_lock lock{mutex};
+			cv.wait(lock, [&] { return stop or not jobs.empty(); });
+			if (jobs.empty()) {
+				return;
+			}
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+		job();
+	}
+}
+
+MultiBus::MultiBus(std::vector<BusConfig> const& configs) {
+	if (configs.empty()) {
+		throw std::runtime_error("MultiBus: at least one bus is required");
+	}
+	for (auto const& config : configs) {
+		auto bus = std::make_unique<Bus>();
+		bus->config = config;
+		bus->usb2dyn = std::make_unique<USB2Dynamixel>(config.baudrate, config.device, config.protocol);
+		mBuses.emplace_back(std::move(bus));
+	}
+	for (auto& bus : mBuses) {
+		bus->worker = std::thread([busPtr = bus.get()] { busPtr->work(); });
+	}
+}
+
+MultiBus::~MultiBus() {
+	for (auto& bus : mBuses) {
+		{
+			std::lock_guard lock{bus->mutex};
+			bus->stop = true;
+		}
+		bus->cv.notify_all();
+	}
+	for (auto& bus : mBuses) {
+		if (bus->worker.joinable()) {
+			bus->worker.join();
+		}
+	}
+}
+
+void MultiBus::assign(MotorID motor, std::size_t busIdx) {
+	if (busIdx >= mBuses.size()) {
+		throw std::runtime_error("MultiBus: invalid bus index " + std::to_string(busIdx));
+	}
+	auto [iter, inserted] = mMotorToBus.try_emplace(motor, busIdx);
+	if (not inserted and iter->second != busIdx) {
+		throw std::runtime_error("MultiBus: motor " + std::to_string(int(motor)) + " is present on " + mBuses[iter->second]->config.device + " and on " + mBuses[busIdx]->config.device);
+	}
+}
+
+auto MultiBus::getBusOf(MotorID motor) const -> std::optional<std::size_t> {
+	auto iter = mMotorToBus.find(motor);
+	if (iter == mMotorToBus.end()) {
+		return std::nullopt;
+	}
+	return iter->second;
+}
+
+auto MultiBus::scan(std::vector<MotorID> const& motors, Timeout timeout) -> std::map<MotorID, std::size_t> {
+	std::vector<std::vector<MotorID>> found(mBuses.size());
+	forEachBus([&](std::size_t busIdx, USB2Dynamixel& usb2dyn) {
+		for (auto id : motors) {
+			if (usb2dyn.ping(id, timeout)) {
+				found[busIdx].push_back(id);
+			}
+		}
+	});
+
+	std::map<MotorID, std::size_t> newMotors;
+	for (std::size_t busIdx{0}; busIdx < found.size(); ++busIdx) {
+		for (auto id : found[busIdx]) {
+			if (not getBusOf(id)) {
+				newMotors[id] = busIdx;
+			}
+			assign(id, busIdx);
+		}
+	}
+	return newMotors;
+}
+
+auto MultiBus::bulk_read(std::vector<std::tuple<MotorID, int, size_t>> const& motors, Timeout timeout) const -> std::vector<std::tuple<bool, MotorID, int, ErrorCode, Parameter>> {
+	std::vector<std::tuple<bool, MotorID, int, ErrorCode, Parameter>> resList;
+	resList.reserve(motors.size());
+	for (auto const& [id, baseRegister, length] : motors) {
+		resList.emplace_back(true, id, baseRegister, ErrorCode{}, Parameter{});
+	}
+
+	auto indices = splitByBus(motors, [](auto const& m) { return std::get<0>(m); });
+	std::vector<std::future<void>> futures;
+	for (std::size_t busIdx{0}; busIdx < mBuses.size(); ++busIdx) {
+		if (indices[busIdx].empty()) {
+			continue;
+		}
+		futures.emplace_back(post(busIdx, [&, busIdx] {
+			auto const& busIndices = indices[busIdx];
+			std::vector<std::tuple<MotorID, int, size_t>> request;
+			request.reserve(busIndices.size());
+			for (auto idx : busIndices) {
+				request.push_back(motors[idx]);
+			}
+			auto response = mBuses[busIdx]->usb2dyn->bulk_read(request, timeout);
+			for (std::size_t i{0}; i < response.size(); ++i) {
+				resList[busIndices[i]] = std::move(response[i]);
+			}
+		}));
+	}
+	waitAll(futures);
+	return resList;
+}
+
+auto MultiBus::sync_read(std::vector<MotorID> const& motors, int baseRegister, size_t length, Timeout timeout) const -> std::vector<std::tuple<bool, MotorID, ErrorCode, Parameter>> {
+	std::vector<std::tuple<bool, MotorID, ErrorCode, Parameter>> resList;
+	resList.reserve(motors.size());
+	for (auto id : motors) {
+		resList.emplace_back(true, id, ErrorCode{}, Parameter{});
+	}
+
+	auto indices = splitByBus(motors, [](auto const& m) { return m; });
+	std::vector<std::future<void>> futures;
+	for (std::size_t busIdx{0}; busIdx < mBuses.size(); ++busIdx) {
+		if (indices[busIdx].empty()) {
+			continue;
+		}
+		futures.emplace_back(post(busIdx, [&, busIdx] {
+			auto const& busIndices = indices[busIdx];
+			auto const& usb2dyn = *mBuses[busIdx]->usb2dyn;
+			if (usb2dyn.supportsSyncRead()) {
+				std::vector<MotorID> request;
+				request.reserve(busIndices.size());
+				for (auto idx : busIndices) {
+					request.push_back(motors[idx]);
+				}
+				auto response = usb2dyn.sync_read(request, baseRegister, length, timeout);
+				for (std::size_t i{0}; i < response.size(); ++i) {
+					resList[busIndices[i]] = std::move(response[i]);
+				}
+			} else {
+				std::vector<std::tuple<MotorID, int, size_t>> request;
+				request.reserve(busIndices.size());
+				for (auto idx : busIndices) {
+					request.emplace_back(motors[idx], baseRegister, length);
+				}
+				auto response = usb2dyn.bulk_read(request, timeout);
+				for (std::size_t i{0}; i < response.size(); ++i) {
+					auto& [timeoutFlag, id, _reg, errorCode, rxBuf] = response[i];
+					resList[busIndices[i]] = std::make_tuple(timeoutFlag, id, errorCode, std::move(rxBuf));
+				}
+			}
+		}));
+	}
+	waitAll(futures);
+	return resList;
+}
+
+void MultiBus::sync_write(std::map<MotorID, Parameter> const& motorParams, int baseRegister) const {
+	std::vector<std::map<MotorID, Parameter>> perBus(mBuses.size());
+	for (auto const& [id, params] : motorParams) {
+		auto busIdx = getBusOf(id);
+		if (not busIdx) {
+			throw std::runtime_error("MultiBus: motor " + std::to_string(int(id)) + " is not assigned to any bus");
+		}
+		perBus[*busIdx].emplace(id, params);
+	}
+
+	std::vector<std::future<void>> futures;
+	for (std::size_t busIdx{0}; busIdx < mBuses.size(); ++busIdx) {
+		if (perBus[busIdx].empty()) {
+			continue;
+		}
+		futures.emplace_back(post(busIdx, [&, busIdx] {
+			mBuses[busIdx]->usb2dyn->sync_write(perBus[busIdx], baseRegister);
+		}));
+	}
+	waitAll(futures);
+}
+
+template <typename T, typename Func>
+void MultiBus::runPrepared(std::vector<std::optional<T>> const& perBus, Func&& func) const {
+	auto numBuses = std::count_if(begin(perBus), end(perBus), [](auto const& p) { return p.has_value(); });
+	if (numBuses == 1) {
+		for (std::size_t busIdx{0}; busIdx < perBus.size(); ++busIdx) {
+			if (perBus[busIdx]) {
+				func(busIdx);
+			}
+		}
+		return;
+	}
+	std::vector<std::future<void>> futures;
+	for (std::size_t busIdx{0}; busIdx < perBus.size(); ++busIdx) {
+		if (perBus[busIdx]) {
+			futures.emplace_back(post(busIdx, [&, busIdx] { func(busIdx); }));
+		}
+	}
+	waitAll(futures);
+}
+
+bool MultiBus::PreparedSyncRead::hasReplied(std::size_t idx) const {
+	auto const& [busIdx, busMotorIdx] = location[idx];
+	return busIdx < perBus.size() and perBus[busIdx]->hasReplied(busMotorIdx);
+}
+
+auto MultiBus::PreparedSyncRead::getErrorCode(std::size_t idx) const -> ErrorCode {
+	auto const& [busIdx, busMotorIdx] = location[idx];
+	return busIdx < perBus.size() ? perBus[busIdx]->getErrorCode(busMotorIdx) : ErrorCode{};
+}
+
+auto MultiBus::PreparedSyncRead::getData(std::size_t idx) const -> ByteSpan {
+	auto const& [busIdx, busMotorIdx] = location[idx];
+	return busIdx < perBus.size() ? perBus[busIdx]->getData(busMotorIdx) : ByteSpan{};
+}
+
+auto MultiBus::prepareSyncRead(std::vector<MotorID> const& motors, int baseRegister, size_t length) const -> PreparedSyncRead {
+	PreparedSyncRead read {motors, std::vector<std::optional<PreparedRead>>(mBuses.size()), {}};
+	read.location.resize(motors.size(), std::make_tuple(std::size_t(-1), std::size_t(0)));
+
+	auto indices = splitByBus(motors, [](auto const& m) { return m; });
+	for (std::size_t busIdx{0}; busIdx < mBuses.size(); ++busIdx) {
+		auto const& busIndices = indices[busIdx];
+		if (busIndices.empty()) {
+			continue;
+		}
+		auto const& usb2dyn = *mBuses[busIdx]->usb2dyn;
+		std::vector<std::tuple<MotorID, int, size_t>> request;
+		request.reserve(busIndices.size());
+		for (std::size_t i{0}; i < busIndices.size(); ++i) {
+			request.emplace_back(motors[busIndices[i]], baseRegister, length);
+			read.location[busIndices[i]] = std::make_tuple(busIdx, i);
+		}
+		if (usb2dyn.supportsSyncRead()) {
+			std::vector<MotorID> ids;
+			for (auto const& m : request) {
+				ids.push_back(std::get<0>(m));
+			}
+			read.perBus[busIdx] = usb2dyn.prepareSyncRead(ids, baseRegister, length);
+		} else {
+			read.perBus[busIdx] = usb2dyn.prepareBulkRead(request);
+		}
+	}
+	return read;
+}
+
+auto MultiBus::execute(PreparedSyncRead& read, Timeout timeout) const -> std::size_t {
+	runPrepared(read.perBus, [&](std::size_t busIdx) {
+		mBuses[busIdx]->usb2dyn->execute(*read.perBus[busIdx], timeout);
+	});
+	std::size_t numReplies {0};
+	for (auto const& busRead : read.perBus) {
+		if (busRead) {
+			numReplies += busRead->getNumReplies();
+		}
+	}
+	return numReplies;
+}
+
+auto MultiBus::prepareSyncWrite(std::vector<MotorID> const& motors, int baseRegister, size_t length) const -> PreparedSyncWrite {
+	for (auto id : motors) {
+		if (not getBusOf(id)) {
+			throw std::runtime_error("MultiBus: motor " + std::to_string(int(id)) + " is not assigned to any bus");
+		}
+	}
+	PreparedSyncWrite write {motors, std::vector<std::optional<SyncWritePacket>>(mBuses.size()), {}};
+	write.location.resize(motors.size());
+
+	auto indices = splitByBus(motors, [](auto const& m) { return m; });
+	for (std::size_t busIdx{0}; busIdx < mBuses.size(); ++busIdx) {
+		auto const& busIndices = indices[busIdx];
+		if (busIndices.empty()) {
+			continue;
+		}
+		std::vector<MotorID> ids;
+		for (std::size_t i{0}; i < busIndices.size(); ++i) {
+			ids.push_back(motors[busIndices[i]]);
+			write.location[busIndices[i]] = std::make_tuple(busIdx, i);
+		}
+		write.perBus[busIdx] = mBuses[busIdx]->usb2dyn->prepareSyncWrite(ids, baseRegister, length);
+	}
+	return write;
+}
+
+void MultiBus::execute(PreparedSyncWrite& write) const {
+	runPrepared(write.perBus, [&](std::size_t busIdx) {
+		mBuses[busIdx]->usb2dyn->sync_write(*write.perBus[busIdx]);
+	});
+}
+
+void MultiBus::forEachBus(std::function<void(std::size_t, USB2Dynamixel&)> const& func) const {
+	std::vector<std::future<void>> futures;
+	for (std::size_t busIdx{0}; busIdx < mBuses.size(); ++busIdx) {
+		futures.emplace_back(post(busIdx, [&, busIdx] {
+			func(busIdx, *mBuses[busIdx]->usb2dyn);
+		}));
+	}
+	waitAll(futures);
+}
+
+auto MultiBus::post(std::size_t busIdx, std::function<void()> job) const -> std::future<void> {
+	auto& bus = *mBuses.at(busIdx);
+	std::packaged_task<void()> task{std::move(job)};
+	auto future = task.get_future();
+	{
+		std::lock_guard lock{bus.mutex};
+		bus.jobs.emplace_back(std::move(task));
+	}
+	bus.cv.notify_one();
+	return future;
+}
+
+}
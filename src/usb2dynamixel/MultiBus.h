@@ -0,0 +1,154 @@
+#pragma once
+
+#include "USB2Dynamixel.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dynamixel {
+
+/**
+ * several usb2dynamixel adapters driven concurrently
+ *
+ * every bus has its own worker thread, a request that touches motors on several buses is split
+ * per bus and all parts run at the same time. Motors are addressed by their id only, hence an id
+ * must be unique across all buses.
+ */
+struct MultiBus {
+	using Timeout = USB2Dynamixel::Timeout;
+
+	struct BusConfig {
+		std::string device;
+		int baudrate {1000000};
+		Protocol protocol {Protocol::V1};
+	};
+
+	explicit MultiBus(std::vector<BusConfig> const& configs);
+	~MultiBus();
+
+	MultiBus(MultiBus const&) = delete;
+	auto operator=(MultiBus const&) -> MultiBus& = delete;
+
+	[[nodiscard]] auto size() const -> std::size_t { return mBuses.size(); }
+	[[nodiscard]] auto getBus(std::size_t busIdx) const -> USB2Dynamixel& { return *mBuses.at(busIdx)->usb2dyn; }
+	[[nodiscard]] auto getConfig(std::size_t busIdx) const -> BusConfig const& { return mBuses.at(busIdx)->config; }
+
+	// make motor reachable through the bus busIdx, throws if it is already known on another bus
+	void assign(MotorID motor, std::size_t busIdx);
+	[[nodiscard]] auto getBusOf(MotorID motor) const -> std::optional<std::size_t>;
+	[[nodiscard]] auto getMotors() const -> std::map<MotorID, std::size_t> const& { return mMotorToBus; }
+
+	/**
+	 * ping the given motors on all buses in parallel and assign every motor that replied
+	 * returns the newly found motors [motorID, busIdx]
+	 */
+	auto scan(std::vector<MotorID> const& motors, Timeout timeout) -> std::map<MotorID, std::size_t>;
+
+	/**
+	 * same as USB2Dynamixel::bulk_read but every bus reads its share of the motors in parallel
+	 * motors that are not assigned to any bus are reported as timed out
+	 */
+	[[nodiscard]] auto bulk_read(std::vector<std::tuple<MotorID, int, size_t>> const& motors, Timeout timeout) const -> std::vector<std::tuple<bool, MotorID, int, ErrorCode, Parameter>>;
+
+	/**
+	 * read the same register window from all motors, buses that speak protocol v2 use a SYNC_READ the others a BULK_READ
+	 * result is in request order, motors that are not assigned to any bus are reported as timed out
+	 */
+	[[nodiscard]] auto sync_read(std::vector<MotorID> const& motors, int baseRegister, size_t length, Timeout timeout) const -> std::vector<std::tuple<bool, MotorID, ErrorCode, Parameter>>;
+
+	// one sync_write per bus, all buses are written in parallel
+	void sync_write(std::map<MotorID, Parameter> const& motorParams, int baseRegister) const;
+
+	/**
+	 * a sync_read of a fixed motor set that is prepared once for every bus and executed repeatedly
+	 * buses that speak protocol v2 use a SYNC_READ the others a BULK_READ (see PreparedRead)
+	 * idx refers to motors, motors that are not assigned to any bus never reply
+	 */
+	struct PreparedSyncRead {
+		std::vector<MotorID> motors;
+
+		[[nodiscard]] bool hasReplied(std::size_t idx) const;
+		[[nodiscard]] auto getErrorCode(std::size_t idx) const -> ErrorCode;
+		[[nodiscard]] auto getData(std::size_t idx) const -> ByteSpan;
+		template <typename LayoutT>
+		bool get(std::size_t idx, LayoutT& layout) const {
+			auto const& [busIdx, busMotorIdx] = location[idx];
+			return busIdx < perBus.size() and perBus[busIdx]->get(busMotorIdx, layout);
+		}
+
+		std::vector<std::optional<PreparedRead>> perBus;
+		std::vector<std::tuple<std::size_t, std::size_t>> location; // [busIdx, index in perBus[busIdx]] of every motor, busIdx is -1 if unassigned
+	};
+	[[nodiscard]] auto prepareSyncRead(std::vector<MotorID> const& motors, int baseRegister, size_t length) const -> PreparedSyncRead;
+	// run the prepared reads of all buses in parallel, returns the number of motors that replied
+	auto execute(PreparedSyncRead& read, Timeout timeout) const -> std::size_t;
+
+	/**
+	 * a sync_write of a fixed motor set that is prepared once for every bus (see SyncWritePacket)
+	 * throws if a motor is not assigned to any bus
+	 */
+	struct PreparedSyncWrite {
+		std::vector<MotorID> motors;
+
+		// set the data that is written to motors[idx]
+		void set(std::size_t idx, ByteSpan data) {
+			auto const& [busIdx, busMotorIdx] = location.at(idx);
+			perBus[busIdx]->set(busMotorIdx, data);
+		}
+
+		std::vector<std::optional<SyncWritePacket>> perBus;
+		std::vector<std::tuple<std::size_t, std::size_t>> location;
+	};
+	[[nodiscard]] auto prepareSyncWrite(std::vector<MotorID> const& motors, int baseRegister, size_t length) const -> PreparedSyncWrite;
+	void execute(PreparedSyncWrite& write) const;
+
+	// run func(busIdx, usb2dyn) on the worker thread of every bus and wait until all are done
+	void forEachBus(std::function<void(std::size_t, USB2Dynamixel&)> const& func) const;
+
+private:
+	struct Bus {
+		BusConfig config;
+		std::unique_ptr<USB2Dynamixel> usb2dyn;
+
+		std::mutex mutex;
+		std::condition_variable cv;
+		std::deque<std::packaged_task<void()>> jobs;
+		bool stop {false};
+		std::thread worker;
+
+		void work();
+	};
+
+	// queue job on the worker thread of the bus busIdx
+	auto post(std::size_t busIdx, std::function<void()> job) const -> std::future<void>;
+	// run func(busIdx) for every bus that has a prepared part, a single bus is served on the calling thread to save the hand over
+	template <typename T, typename Func>
+	void runPrepared(std::vector<std::optional<T>> const& perBus, Func&& func) const;
+
+	// split the indices of motors by the bus they are assigned to, unknown motors are skipped
+	template <typename T, typename GetID>
+	auto splitByBus(std::vector<T> const& motors, GetID&& getID) const -> std::vector<std::vector<std::size_t>> {
+		std::vector<std::vector<std::size_t>> indices(mBuses.size());
+		for (std::size_t idx{0}; idx < motors.size(); ++idx) {
+			auto iter = mMotorToBus.find(getID(motors[idx]));
+			if (iter != mMotorToBus.end()) {
+				indices[iter->second].push_back(idx);
+			}
+		}
+		return indices;
+	}
+
+	std::vector<std::unique_ptr<Bus>> mBuses;
+	std::map<MotorID, std::size_t> mMotorToBus;
+};
+
+}
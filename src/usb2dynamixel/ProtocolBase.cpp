@@ -0,0 +1,35 @@
+#include "ProtocolBase.h"
+#include "file_io.h"
+
+namespace dynamixel {
+
+auto ProtocolBase::receivePacket(Timeout timeout, MotorID expectedMotorID, std::size_t numParameters, simplyfile::SerialPort const& port, RxBuffer& rxBuffer) const -> std::tuple<bool, MotorID, ErrorCode, ByteSpan> {
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	while (true) {
+		while (auto packet = decodePacket(rxBuffer)) {
+			auto [motorID, errorCode, payload] = extractStatus(*packet);
+			if (motorID == MotorIDInvalid or payload.size() != numParameters) {
+				continue;
+			}
+			if (expectedMotorID != BroadcastID and motorID != expectedMotorID) {
+				continue;
+			}
+			return std::make_tuple(false, motorID, errorCode, payload);
+		}
+		if (rxBuffer.fill(port) > 0) {
+			continue;
+		}
+		auto remaining = remainingTime(startTime, timeout);
+		if (remaining.count() == 0) {
+			break;
+		}
+		// nothing pending, sleep until the port becomes readable instead of spinning
+		file_io::waitForData(port, remaining);
+	}
+	rxBuffer.clear();
+	file_io::flushRead(port);
+	return std::make_tuple(true, MotorIDInvalid, ErrorCode{}, ByteSpan{});
+}
+
+}
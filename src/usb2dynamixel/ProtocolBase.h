@@ -1,10 +1,15 @@
 #pragma once
 
 #include "dynamixel.h"
+#include "RxBuffer.h"
+#include "file_io.h"
 
 #include <simplyfile/SerialPort.h>
 
+#include <algorithm>
+#include <array>
 #include <chrono>
+#include <optional>
 
 namespace dynamixel {
 
@@ -18,35 +23,161 @@ enum class ErrorCode : uint8_t {
 	Instruction   = 0x40
 };
 
+/**
+ * a validated packet as it was decoded from an RxBuffer
+ * parameters point into the buffer (escapes are already removed) and stay valid until the buffer is filled again
+ */
+struct Packet {
+	MotorID  motorID;
+	uint8_t  instruction; // status packets of protocol v1 carry the error field here
+	ByteSpan parameters;
+};
 
 struct ProtocolBase {
 	using Timeout = std::chrono::high_resolution_clock::duration;
 	virtual ~ProtocolBase() {}
 
 	[[nodiscard]] virtual auto createPacket(MotorID motorID, Instruction instr, Parameter data) const -> Parameter = 0;
+
+	/**
+	 * everything in front of and behind the parameters of a packet
+	 * together with the parameters (which can be spread over several buffers) this can be sent with a single writev
+	 */
+	struct PacketFrame {
+		std::array<std::byte, 8> header;
+		std::size_t headerSize {0};
+		std::array<std::byte, 2> trailer;
+		std::size_t trailerSize {0};
+	};
+
+	/**
+	 * frame the parameters which are given as numPieces consecutive pieces
+	 * returns false if the parameters cannot be sent as they are (they need byte stuffing), createPacket has to be used then
+	 */
+	[[nodiscard]] virtual bool framePacket(MotorID motorID, Instruction instr, ByteSpan const* pieces, std::size_t numPieces, PacketFrame& frame) const = 0;
+
 	/**
-	 * receive a packet that contains numParameters bytes of payload
-	 * return the whole raw packet or an empty vector if a timeout happened or and invalid packet was received
+	 * recompute the checksum of a packet that was built by createPacket and whose parameters were modified in place
+	 * the amount of parameters must not change, returns false if the parameters now need byte stuffing
 	 */
-	[[nodiscard]] virtual auto readPacket(Timeout timeout, uint8_t expectedMotorID, std::size_t numParameters, simplyfile::SerialPort const& port) const -> std::tuple<bool, MotorID, ErrorCode, Parameter> = 0;
+	[[nodiscard]] virtual bool updateChecksum(Parameter& packet) const = 0;
+	// offset of the first parameter in a packet (as long as no byte stuffing is involved)
+	[[nodiscard]] virtual auto parameterOffset() const -> std::size_t = 0;
 
+	/**
+	 * receive a status packet that contains numParameters bytes of payload
+	 *
+	 * return value
+	 * [timeoutFlag, motorID, errorCode, payload] = receivePacket(...);
+	 *
+	 * timeoutFlag indicates if no matching packet was received in time
+	 * motorID     the id of the sender or MotorIDInvalid
+	 * errorCode   errorCode flags from the return message
+	 * payload     points into rxBuffer and is valid until rxBuffer is filled again
+	 *
+	 * bytes that were received after the packet stay in rxBuffer for the next call
+	 */
+	[[nodiscard]] auto receivePacket(Timeout timeout, MotorID expectedMotorID, std::size_t numParameters, simplyfile::SerialPort const& port, RxBuffer& rxBuffer) const -> std::tuple<bool, MotorID, ErrorCode, ByteSpan>;
 
-	/** process a received packet by validating it and stripping it to the payload
+	/**
+	 * receive a burst of status packets (e.g. the replies to a bulk read) in one pass
+	 * packets are matched to motors by their id regardless of the order in which they arrive
 	 *
-	 *  return value
-	 *  [validFlag, motorID, errorCode, parameters] = readPacket(...);
+	 * motors     list of [motorID, baseRegister, length] that are expected to reply
+	 * cb         called as cb(index, errorCode, payload) for every matching packet,
+	 *            index refers to motors and payload is only valid during the call
+	 * timeout    the time to wait for the next packet, a motor that does not reply does not stop the collection
 	 *
-	 *  validFlag   indicates if the packet was valid
-	 *  motorID     inidcates if parameters form a valid packet, withc MotorIDInvalid
-	 *  errorCode   errorCode flags from the return message
-	 *  paremeters  is a vector with the actual payload
+	 * returns the number of motors that replied
 	 */
-//	[[nodiscard]] virtual auto validateRawPacket(Parameter const& raw_packet) const -> std::tuple<MotorID, ErrorCode, Parameter> = 0;
+	template <typename CB>
+	auto receivePackets(Timeout timeout, std::vector<std::tuple<MotorID, int, std::size_t>> const& motors, simplyfile::SerialPort const& port, RxBuffer& rxBuffer, CB&& cb) const -> std::size_t;
+
+	/**
+	 * decode the next valid packet from the front of rxBuffer
+	 * garbage and invalid packets are dropped, an incomplete packet is left in the buffer
+	 * returns std::nullopt if more bytes are needed to complete a packet
+	 */
+	[[nodiscard]] virtual auto decodePacket(RxBuffer& rxBuffer) const -> std::optional<Packet> = 0;
+
+	/**
+	 * interpret a decoded packet as status packet
+	 * [motorID, errorCode, payload] = extractStatus(packet);
+	 * motorID is MotorIDInvalid if packet is not a status packet
+	 */
+	[[nodiscard]] virtual auto extractStatus(Packet const& packet) const -> std::tuple<MotorID, ErrorCode, ByteSpan> = 0;
+
+	// bytes on the wire of an instruction or status packet with numParameters bytes of parameters (byte stuffing not included)
+	[[nodiscard]] virtual auto instructionPacketSize(std::size_t numParameters) const -> std::size_t = 0;
+	[[nodiscard]] virtual auto statusPacketSize(std::size_t numParameters) const -> std::size_t = 0;
 
 	[[nodiscard]] virtual auto convertLength(size_t len) const -> Parameter = 0;
 	[[nodiscard]] virtual auto convertAddress(int addr) const -> Parameter = 0;
+	// same as convertLength and convertAddress but without allocation, out needs room for two bytes, return the number of bytes written
+	virtual auto writeLength(size_t len, std::byte* out) const -> std::size_t = 0;
+	virtual auto writeAddress(int addr, std::byte* out) const -> std::size_t = 0;
 
 	[[nodiscard]] virtual auto buildBulkReadPackage(std::vector<std::tuple<MotorID, int, size_t>> const& motors) const -> std::vector<std::byte> = 0;
+	[[nodiscard]] virtual auto buildSyncReadPackage(std::vector<MotorID> const& motors, int baseRegister, size_t length) const -> std::vector<std::byte> = 0;
+	[[nodiscard]] virtual auto buildBulkWritePackage(std::vector<std::tuple<MotorID, int, Parameter>> const& motors) const -> std::vector<std::byte> = 0;
+
+protected:
+	/**
+	 * the time left until timeout expires when started at startTime
+	 * a timeout of zero means "no timeout" and results in a negative duration (wait indefinitely)
+	 */
+	[[nodiscard]] static auto remainingTime(std::chrono::high_resolution_clock::time_point startTime, Timeout timeout) -> Timeout {
+		if (timeout.count() == 0) {
+			return Timeout{-1};
+		}
+		return std::max(Timeout{0}, startTime + timeout - std::chrono::high_resolution_clock::now());
+	}
 };
 
+template <typename CB>
+auto ProtocolBase::receivePackets(Timeout timeout, std::vector<std::tuple<MotorID, int, std::size_t>> const& motors, simplyfile::SerialPort const& port, RxBuffer& rxBuffer, CB&& cb) const -> std::size_t {
+	// maps a motor id to its index in motors, -1 if not expected (anymore)
+	std::array<int, 256> pending;
+	pending.fill(-1);
+	for (std::size_t idx{0}; idx < motors.size(); ++idx) {
+		pending[std::get<0>(motors[idx])] = idx;
+	}
+
+	std::size_t received {0};
+	auto startTime = std::chrono::high_resolution_clock::now();
+	while (received < motors.size()) {
+		while (auto packet = decodePacket(rxBuffer)) {
+			auto [motorID, errorCode, payload] = extractStatus(*packet);
+			if (motorID == MotorIDInvalid or pending[motorID] == -1) {
+				continue;
+			}
+			auto idx = pending[motorID];
+			if (payload.size() != std::get<2>(motors[idx])) {
+				continue;
+			}
+			pending[motorID] = -1;
+			cb(std::size_t(idx), errorCode, payload);
+			++received;
+			startTime = std::chrono::high_resolution_clock::now();
+		}
+		if (received == motors.size()) {
+			return received;
+		}
+		if (rxBuffer.fill(port) > 0) {
+			continue;
+		}
+		auto remaining = remainingTime(startTime, timeout);
+		if (remaining.count() == 0) {
+			break;
+		}
+		// nothing pending, sleep until the port becomes readable instead of spinning
+		file_io::waitForData(port, remaining);
+	}
+	if (received < motors.size()) {
+		rxBuffer.clear();
+		file_io::flushRead(port);
+	}
+	return received;
+}
+
 }
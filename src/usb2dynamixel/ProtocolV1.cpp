@@ -1,15 +1,13 @@
 #include "ProtocolV1.h"
-#include "file_io.h"
 
+#include <array>
 #include <cstring>
 #include <stdexcept>
 
 
 namespace dynamixel {
-namespace {
 
-[[nodiscard]]
-std::byte calculateChecksum(Parameter const& packet) {
+auto ProtocolV1::calculateChecksum(Parameter const& packet) -> std::byte {
 	uint32_t checkSum = 0;
 	for (size_t i(2); i < packet.size(); ++i) {
 		checkSum += uint8_t(packet[i]);
@@ -17,27 +15,12 @@ std::byte calculateChecksum(Parameter const& packet) {
 	return std::byte(~checkSum);
 }
 
-[[nodiscard]]
-bool validatePacket(Parameter const& rxBuf) {
-	if (rxBuf.size() > 255) {
-		return false;
-	}
-	if (rxBuf.size() < 4) {
-		return false;
-	}
-
-	bool success = 0xff == uint8_t(rxBuf[0]);
-	success &= 0xff == uint8_t(rxBuf[1]);
-	success &= 0xff != uint8_t(rxBuf[2]);
-	success &= (rxBuf.size() - 4) == uint8_t(rxBuf[3]);
+bool ProtocolV1::validateChecksum(std::byte const* packet, std::size_t size) {
 	uint8_t checkSum = 0;
-	for (size_t i(2); i < rxBuf.size(); ++i) {
-		checkSum += uint8_t(rxBuf[i]);
+	for (std::size_t i(2); i < size; ++i) {
+		checkSum += uint8_t(packet[i]);
 	}
-	success &= 0xff == uint8_t(checkSum);
-	return success;
-}
-
+	return 0xff == checkSum;
 }
 
 auto ProtocolV1::createPacket(MotorID motorID, Instruction instr, Parameter data) const -> Parameter {
@@ -46,9 +29,12 @@ auto ProtocolV1::createPacket(MotorID motorID, Instruction instr, Parameter data
 	}
 	uint8_t length = 2 + data.size();
 
-	Parameter txBuf {
-		std::byte{0xff}, std::byte{0xff}, std::byte{motorID}, std::byte{length}, std::byte(instr)
-	};
+	// header, parameters and checksum are allocated at once
+	Parameter txBuf;
+	txBuf.reserve(6 + data.size());
+	for (auto b : {std::byte{0xff}, std::byte{0xff}, std::byte{motorID}, std::byte{length}, std::byte(instr)}) {
+		txBuf.push_back(b);
+	}
 	txBuf.insert(txBuf.end(), data.begin(), data.end());
 
 	txBuf.push_back(calculateChecksum(txBuf));
@@ -56,128 +42,120 @@ auto ProtocolV1::createPacket(MotorID motorID, Instruction instr, Parameter data
 	return txBuf;
 }
 
-
-Parameter ProtocolV1::synchronizeOnHeader(Timeout timeout, MotorID expectedMotorID, std::size_t numParameters, simplyfile::SerialPort const& port) const {
-	Parameter preambleBuffer;
-	struct __attribute__((packed)) Header {
-		std::array<std::byte, 2> syncMarker;
-		uint8_t id;
-		uint8_t length;
-		uint8_t error;
-	};
-	std::array<std::byte, 2> syncMarker = {std::byte{0xff}, std::byte{0xff}};
-	auto startTime = std::chrono::high_resolution_clock::now();
-	while (not ((timeout.count() != 0) and (std::chrono::high_resolution_clock::now() - startTime >= timeout))) {
-		// figure out how many bytes have to be read
-		int indexOfSyncMarker = 0;
-		for (;indexOfSyncMarker <= static_cast<int>(preambleBuffer.size())-static_cast<int>(sizeof(syncMarker)); ++indexOfSyncMarker) {
-			if (0 == std::memcmp(&preambleBuffer[indexOfSyncMarker], syncMarker.data(), sizeof(syncMarker))) {
-				break;
-			}
-		}
-		preambleBuffer.erase(preambleBuffer.begin(), preambleBuffer.begin()+indexOfSyncMarker);
-		int bytesToRead = std::max(1, static_cast<int>(sizeof(Header)+1) - static_cast<int>(preambleBuffer.size()));
-		auto buffer = file_io::read(port, bytesToRead);
-		preambleBuffer.insert(preambleBuffer.end(), buffer.begin(), buffer.end());
-		if (preambleBuffer.size() >= sizeof(Header)) {
-			// test if this preamble contains the header of the packet we were looking for
-			Header header;
-			std::memcpy(&header, preambleBuffer.data(), sizeof(Header));
-			if (header.syncMarker == syncMarker and header.length+2 >= static_cast<int>(numParameters)) {
-				// found a synchronization token and a "matching" packet
-				if (expectedMotorID != 0xfe) {
-					if (expectedMotorID == header.id) {
-						return preambleBuffer;
-					}
-					// received an unexpected header -> flush this header and continue reading
-					preambleBuffer.clear();
-				} else {
-					return preambleBuffer;
-				}
-			}
+bool ProtocolV1::framePacket(MotorID motorID, Instruction instr, ByteSpan const* pieces, std::size_t numPieces, PacketFrame& frame) const {
+	std::size_t numParameters {0};
+	uint32_t checkSum {0};
+	for (std::size_t i{0}; i < numPieces; ++i) {
+		numParameters += pieces[i].size();
+		for (auto b : pieces[i]) {
+			checkSum += uint8_t(b);
 		}
 	}
-	return {};
+	if (numParameters > 253) {
+		throw std::runtime_error("packet is longer than 255 bytes, not supported in protocol v1");
+	}
+	uint8_t length = 2 + numParameters;
+	frame.header = {std::byte{0xff}, std::byte{0xff}, std::byte{motorID}, std::byte{length}, std::byte(instr)};
+	frame.headerSize = 5;
+	checkSum += uint8_t(motorID) + length + uint8_t(instr);
+	frame.trailer[0] = std::byte(~checkSum);
+	frame.trailerSize = 1;
+	return true;
 }
 
-auto ProtocolV1::readPacket(Timeout timeout, MotorID expectedMotorID, std::size_t numParameters, simplyfile::SerialPort const& port) const -> std::tuple<bool, MotorID, ErrorCode, Parameter> {
-	bool timeoutFlag = false;
-	auto startTime = std::chrono::high_resolution_clock::now();
-
-	while (not timeoutFlag) {
-		// read a header (headers consist of 5 bytes)
-		Parameter preambleBuffer;
-		auto testTimeout = [&]{ return (timeout.count() != 0) and (std::chrono::high_resolution_clock::now() - startTime >= timeout);};
-		Parameter rxBuf = synchronizeOnHeader(timeout, expectedMotorID, numParameters, port);
-		if (rxBuf.size() < 5) { // if we could not synchronize on a header bail out
-			break;
+bool ProtocolV1::updateChecksum(Parameter& packet) const {
+	uint32_t checkSum = 0;
+	for (size_t i(2); i + 1 < packet.size(); ++i) {
+		checkSum += uint8_t(packet[i]);
+	}
+	packet.back() = std::byte(~checkSum);
+	return true;
+}
+
+auto ProtocolV1::decodePacket(RxBuffer& rxBuffer) const -> std::optional<Packet> {
+	static constexpr std::array<std::byte, 2> syncMarker = {std::byte{0xff}, std::byte{0xff}};
+	// sync marker, id, length
+	constexpr std::size_t headerSize = 4;
+
+	while (rxBuffer.synchronize(syncMarker.data(), syncMarker.size())) {
+		if (rxBuffer.size() < headerSize) {
+			return std::nullopt;
 		}
-		std::size_t incomingLength = numParameters + 6;
-		while (rxBuf.size() < incomingLength and not timeoutFlag) {
-			auto buffer = file_io::read(port, incomingLength - rxBuf.size());
-			rxBuf.insert(rxBuf.end(), buffer.begin(), buffer.end());
-			timeoutFlag = testTimeout();
-		};
-		if (timeoutFlag) {
-			break;
+		std::byte* raw = rxBuffer.data();
+		std::size_t length = uint8_t(raw[3]);
+		if (raw[2] == std::byte{0xff} or length < 2) {
+			// this cannot be the start of a packet, resynchronize on the next marker
+			rxBuffer.consume(1);
+			continue;
 		}
-		auto  [motorID, errorCode, payload] = extractPayload(rxBuf);
-		if (payload.size() != numParameters or motorID != expectedMotorID) {
+		std::size_t packetSize = length + headerSize;
+		if (rxBuffer.size() < packetSize) {
+			return std::nullopt;
+		}
+		if (not validateChecksum(raw, packetSize)) {
+			rxBuffer.consume(1);
 			continue;
 		}
-		return std::make_tuple(false, motorID, errorCode, payload);
+		Packet packet {MotorID(raw[2]), uint8_t(raw[4]), ByteSpan{raw + 5, length - 2}};
+		rxBuffer.consume(packetSize);
+		return packet;
 	}
-	file_io::flushRead(port);
-	return std::make_tuple(true, MotorIDInvalid, ErrorCode{}, Parameter{});
+	return std::nullopt;
 }
 
-auto ProtocolV1::extractPayload(Parameter const& raw_packet) const -> std::tuple<MotorID, ErrorCode, Parameter> {
-	if (not validatePacket(raw_packet)) {
-		return std::make_tuple(MotorIDInvalid, ErrorCode{}, Parameter{});
-	}
+auto ProtocolV1::extractStatus(Packet const& packet) const -> std::tuple<MotorID, ErrorCode, ByteSpan> {
+	return std::make_tuple(packet.motorID, ErrorCode(packet.instruction), packet.parameters);
+}
 
-	auto motorID = MotorID(raw_packet[2]);
-	auto errorCode = ErrorCode(raw_packet[4]);
-	int len = static_cast<int>(raw_packet[3]);
-	Parameter payload;
-	payload.insert(payload.end(), std::next(raw_packet.begin(), 5), std::next(raw_packet.begin(), 5+len-2));
+auto ProtocolV1::convertLength(size_t len) const -> Parameter {
+	Parameter txBuf(1);
+	writeLength(len, txBuf.data());
+	return txBuf;
+}
 
-	return std::make_tuple(motorID, errorCode, std::move(payload));
+auto ProtocolV1::convertAddress(int addr) const -> Parameter {
+	Parameter txBuf(1);
+	writeAddress(addr, txBuf.data());
+	return txBuf;
 }
 
-auto ProtocolV1::convertLength(size_t len) const -> Parameter {
+auto ProtocolV1::writeLength(size_t len, std::byte* out) const -> std::size_t {
 	if (len > 255) {
 		throw std::runtime_error("packet is longer than 255 bytes, not supported in protocol v1");
 	}
-
-	return {std::byte(len)};
+	out[0] = std::byte(len);
+	return 1;
 }
 
-auto ProtocolV1::convertAddress(int addr) const -> Parameter {
+auto ProtocolV1::writeAddress(int addr, std::byte* out) const -> std::size_t {
 	if (addr > 255) {
 		throw std::runtime_error("baseRegister above 255 are not supported in protocol v1");
 	}
-
-	return {std::byte(addr)};
+	out[0] = std::byte(addr);
+	return 1;
 }
 
 auto ProtocolV1::buildBulkReadPackage(std::vector<std::tuple<MotorID, int, size_t>> const& motors) const -> std::vector<std::byte> {
 	std::vector<std::byte> txBuf;
 
-	txBuf.reserve(motors.size()*3+1);
-	txBuf.push_back(std::byte{0x00});
+	txBuf.resize(motors.size()*3+1);
+	auto out = txBuf.data();
+	*out++ = std::byte{0x00};
 	for (auto const& [id, baseRegister, length] : motors) {
-		for (auto b : convertLength(length)) {
-			txBuf.push_back(b);
-		}
-		txBuf.push_back(std::byte{id});
-		for (auto b : convertAddress(baseRegister)) {
-			txBuf.push_back(b);
-		}
+		out += writeLength(length, out);
+		*out++ = std::byte{id};
+		out += writeAddress(baseRegister, out);
 	}
 
 	return txBuf;
 }
 
+auto ProtocolV1::buildSyncReadPackage(std::vector<MotorID> const&, int, size_t) const -> std::vector<std::byte> {
+	throw std::runtime_error("sync read is not supported in protocol v1");
+}
+
+auto ProtocolV1::buildBulkWritePackage(std::vector<std::tuple<MotorID, int, Parameter>> const&) const -> std::vector<std::byte> {
+	throw std::runtime_error("bulk write is not supported in protocol v1");
+}
 
 }
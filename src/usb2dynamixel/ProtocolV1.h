@@ -6,16 +6,31 @@ namespace dynamixel {
 
 struct ProtocolV1 : public ProtocolBase {
 	[[nodiscard]] auto createPacket(MotorID motorID, Instruction instr, Parameter data) const -> Parameter override;
-	[[nodiscard]] auto readPacket(Timeout timeout, MotorID expectedMotorID, std::size_t numParameters, simplyfile::SerialPort const& port) const -> std::tuple<bool, MotorID, ErrorCode, Parameter> override;
-	[[nodiscard]] auto extractPayload(Parameter const& raw_packet) const -> std::tuple<MotorID, ErrorCode, Parameter>;
+	[[nodiscard]] bool framePacket(MotorID motorID, Instruction instr, ByteSpan const* pieces, std::size_t numPieces, PacketFrame& frame) const override;
+	[[nodiscard]] bool updateChecksum(Parameter& packet) const override;
+	[[nodiscard]] auto parameterOffset() const -> std::size_t override { return 5; }
+
+	[[nodiscard]] auto decodePacket(RxBuffer& rxBuffer) const -> std::optional<Packet> override;
+	[[nodiscard]] auto extractStatus(Packet const& packet) const -> std::tuple<MotorID, ErrorCode, ByteSpan> override;
+
+	// header(2) id length instruction checksum
+	[[nodiscard]] auto instructionPacketSize(std::size_t numParameters) const -> std::size_t override { return 6 + numParameters; }
+	// header(2) id length error checksum
+	[[nodiscard]] auto statusPacketSize(std::size_t numParameters) const -> std::size_t override { return 6 + numParameters; }
 
 	auto convertLength(size_t len) const -> Parameter override;
 	auto convertAddress(int addr)  const -> Parameter override;
+	auto writeLength(size_t len, std::byte* out) const -> std::size_t override;
+	auto writeAddress(int addr, std::byte* out)  const -> std::size_t override;
 
 	auto buildBulkReadPackage(std::vector<std::tuple<MotorID, int, size_t>> const& motors) const -> std::vector<std::byte> override;
+	auto buildSyncReadPackage(std::vector<MotorID> const& motors, int baseRegister, size_t length) const -> std::vector<std::byte> override;
+	auto buildBulkWritePackage(std::vector<std::tuple<MotorID, int, Parameter>> const& motors) const -> std::vector<std::byte> override;
 
-private:
-	Parameter synchronizeOnHeader(Timeout timeout, MotorID expectedMotorID, std::size_t numParameters, simplyfile::SerialPort const& port) const;
+	// the inverted sum of everything behind the sync marker
+	[[nodiscard]] static auto calculateChecksum(Parameter const& packet) -> std::byte;
+	// true if the packet including its checksum at the end sums up correctly
+	[[nodiscard]] static bool validateChecksum(std::byte const* packet, std::size_t size);
 };
 
 }
@@ -6,16 +6,41 @@ namespace dynamixel {
 
 struct ProtocolV2 : public ProtocolBase {
 	[[nodiscard]] auto createPacket(MotorID motorID, Instruction instr, Parameter data) const -> Parameter override;
-	[[nodiscard]] auto readPacket(Timeout timeout, MotorID expectedMotorID, std::size_t numParameters, simplyfile::SerialPort const& port) const -> std::tuple<bool, MotorID, ErrorCode, Parameter> override;
-	[[nodiscard]] auto extractPayload(Parameter const& raw_packet) const -> std::tuple<MotorID, ErrorCode, Parameter>;
+	[[nodiscard]] bool framePacket(MotorID motorID, Instruction instr, ByteSpan const* pieces, std::size_t numPieces, PacketFrame& frame) const override;
+	[[nodiscard]] bool updateChecksum(Parameter& packet) const override;
+	[[nodiscard]] auto parameterOffset() const -> std::size_t override { return 8; }
+
+	[[nodiscard]] auto decodePacket(RxBuffer& rxBuffer) const -> std::optional<Packet> override;
+	[[nodiscard]] auto extractStatus(Packet const& packet) const -> std::tuple<MotorID, ErrorCode, ByteSpan> override;
+
+	// header(3) reserved id length(2) instruction crc(2)
+	[[nodiscard]] auto instructionPacketSize(std::size_t numParameters) const -> std::size_t override { return 10 + numParameters; }
+	// header(3) reserved id length(2) instruction error crc(2)
+	[[nodiscard]] auto statusPacketSize(std::size_t numParameters) const -> std::size_t override { return 11 + numParameters; }
 
 	auto convertLength(size_t len) const -> Parameter override;
 	auto convertAddress(int addr)  const -> Parameter override;
+	auto writeLength(size_t len, std::byte* out) const -> std::size_t override;
+	auto writeAddress(int addr, std::byte* out)  const -> std::size_t override;
 
 	auto buildBulkReadPackage(std::vector<std::tuple<MotorID, int, size_t>> const& motors) const -> std::vector<std::byte> override;
+	auto buildSyncReadPackage(std::vector<MotorID> const& motors, int baseRegister, size_t length) const -> std::vector<std::byte> override;
+	auto buildBulkWritePackage(std::vector<std::tuple<MotorID, int, Parameter>> const& motors) const -> std::vector<std::byte> override;
+
+	// crc16 (polynomial 0x8005) over [begin, end), see Crc16.h
+	[[nodiscard]] static auto calculateChecksum(std::byte const* begin, std::byte const* end) -> uint16_t;
 
-private:
-	Parameter synchronizeOnHeader(Timeout timeout, MotorID expectedMotorID, std::size_t numParameters, simplyfile::SerialPort const& port) const;
+	/**
+	 * build an instruction packet in txBuf
+	 * the header is written first and the parameters are byte stuffed directly behind it while the checksum is computed,
+	 * the capacity of txBuf is reused, hence a buffer that is passed in repeatedly is allocated only once
+	 */
+	static void encodePacket(Parameter& txBuf, MotorID motorID, Instruction instr, ByteSpan data);
+	// byte stuffing: every 0xff 0xff 0xfd in data is followed by another 0xfd when appended to out
+	// crc is updated with the appended bytes, returns the number of inserted escape bytes
+	static auto appendEscaped(Parameter& out, ByteSpan data, uint16_t& crc) -> std::size_t;
+	// remove the byte stuffing in place and return the new end of the range
+	[[nodiscard]] static auto removeEscapes(std::byte* start, std::byte* end) -> std::byte*;
 };
 
 }
@@ -0,0 +1,191 @@
+#include "ReadPlanner.h"
+
+#include "MotorMetaInfo.h"
+#include "ProtocolV1.h"
+#include "ProtocolV2.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace dynamixel {
+
+namespace {
+
+auto getProtocol(Protocol protocol) -> ProtocolBase const& {
+	static ProtocolV1 const v1;
+	static ProtocolV2 const v2;
+	if (protocol == Protocol::V1) {
+		return v1;
+	}
+	return v2;
+}
+
+}
+
+auto ReadCostModel::requestBytes(std::size_t numMotors) const -> std::size_t {
+	auto const& p = getProtocol(protocol);
+	if (syncRead) {
+		// address, length and the ids
+		return p.instructionPacketSize(4 + numMotors);
+	}
+	if (protocol == Protocol::V1) {
+		// a leading zero and [length, id, address] of every motor
+		return p.instructionPacketSize(1 + 3 * numMotors);
+	}
+	// [id, address, length] of every motor
+	return p.instructionPacketSize(5 * numMotors);
+}
+
+auto ReadCostModel::replyBytes(std::size_t numMotors, std::size_t length) const -> std::size_t {
+	return numMotors * getProtocol(protocol).statusPacketSize(length);
+}
+
+auto ReadCostModel::maxLength() const -> std::size_t {
+	// the length field counts the payload plus error and checksum (protocol v2: plus instruction)
+	return protocol == Protocol::V1 ? 0xff - 2 : 0xffff - 4;
+}
+
+auto ReadCostModel::estimate(std::size_t numMotors, std::size_t length) const -> std::chrono::nanoseconds {
+	auto bytes = requestBytes(numMotors) + replyBytes(numMotors, length);
+	return std::chrono::nanoseconds{int64_t(bytes) * 10 * 1'000'000'000 / baudrate} + overhead;
+}
+
+auto makeCostModel(USB2Dynamixel const& usb2dyn, std::vector<MotorID> const& motors) -> ReadCostModel {
+	ReadCostModel model;
+	model.protocol = usb2dyn.getProtocol();
+	model.baudrate = usb2dyn.getBaudrate();
+	model.syncRead = usb2dyn.supportsSyncRead();
+	model.overhead = usb2dyn.getLatency();
+	for (auto motor : motors) {
+		model.overhead += usb2dyn.getReturnDelay(motor);
+	}
+	return model;
+}
+
+auto ReadPlan::locate(int reg) const -> std::optional<std::tuple<std::size_t, std::size_t>> {
+	for (std::size_t idx{0}; idx < windows.size(); ++idx) {
+		auto const& [baseRegister, length] = windows[idx];
+		if (reg >= baseRegister and reg < baseRegister + int(length)) {
+			return std::make_tuple(idx, std::size_t(reg - baseRegister));
+		}
+	}
+	return std::nullopt;
+}
+
+auto planRead(ReadCostModel const& model, std::vector<MotorID> const& motors, std::vector<std::tuple<int, std::size_t>> registers) -> ReadPlan {
+	if (motors.empty() or registers.empty()) {
+		throw std::runtime_error("planRead: need motors and registers");
+	}
+	// overlapping registers are read as one block, a window never splits them
+	std::sort(begin(registers), end(registers));
+	std::vector<std::tuple<int, int>> blocks; // [begin, end)
+	for (auto const& [reg, length] : registers) {
+		auto end = reg + int(length);
+		if (not blocks.empty() and reg < std::get<1>(blocks.back())) {
+			std::get<1>(blocks.back()) = std::max(std::get<1>(blocks.back()), end);
+		} else {
+			blocks.emplace_back(reg, end);
+		}
+	}
+
+	// best[j] is the cheapest plan for the first j blocks, the last window of it starts at block first[j]
+	auto const n = blocks.size();
+	auto const infinite = std::chrono::nanoseconds::max();
+	std::vector<std::chrono::nanoseconds> best(n + 1, infinite);
+	std::vector<std::size_t> first(n + 1, 0);
+	best[0] = std::chrono::nanoseconds{0};
+	for (std::size_t j{1}; j <= n; ++j) {
+		for (std::size_t i{0}; i < j; ++i) {
+			auto length = std::size_t(std::get<1>(blocks[j-1]) - std::get<0>(blocks[i]));
+			if (length > model.maxLength() or best[i] == infinite) {
+				continue;
+			}
+			auto time = best[i] + model.estimate(motors.size(), length);
+			if (time < best[j]) {
+				best[j]  = time;
+				first[j] = i;
+			}
+		}
+		if (best[j] == infinite) {
+			throw std::runtime_error("planRead: register " + std::to_string(std::get<0>(blocks[j-1])) + " is longer than a single read");
+		}
+	}
+
+	ReadPlan plan;
+	plan.motors = motors;
+	plan.estimatedTime = best[n];
+	for (auto j = n; j > 0; j = first[j]) {
+		auto baseRegister = std::get<0>(blocks[first[j]]);
+		auto length       = std::size_t(std::get<1>(blocks[j-1]) - baseRegister);
+		plan.windows.emplace_back(baseRegister, length);
+		plan.wireBytes += model.requestBytes(motors.size()) + model.replyBytes(motors.size(), length);
+	}
+	std::reverse(begin(plan.windows), end(plan.windows));
+	return plan;
+}
+
+auto planRead(USB2Dynamixel const& usb2dyn, LayoutType layout, std::vector<MotorID> const& motors, std::vector<int> const& registers) -> ReadPlan {
+	std::vector<std::tuple<int, std::size_t>> fields;
+	meta::forAllLayoutTypes([&](auto const& _info) {
+		using Info     = std::decay_t<decltype(_info)>;
+		using Register = typename std::decay_t<decltype(Info::getInfos())>::key_type;
+		if (Info::Type != layout) {
+			return;
+		}
+		auto const& infos = Info::getInfos();
+		for (auto reg : registers) {
+			auto iter = infos.find(Register(reg));
+			if (iter == infos.end()) {
+				throw std::runtime_error("register " + std::to_string(reg) + " is unknown for layout " + to_string(layout));
+			}
+			fields.emplace_back(reg, iter->second.length);
+		}
+	});
+	if (fields.size() != registers.size()) {
+		throw std::runtime_error("layout " + to_string(layout) + " has no register information");
+	}
+	return planRead(makeCostModel(usb2dyn, motors), motors, std::move(fields));
+}
+
+auto PlannedRead::get(std::size_t idx, int reg, std::size_t length) const -> std::optional<ByteSpan> {
+	auto location = plan.locate(reg);
+	if (not location) {
+		return std::nullopt;
+	}
+	auto [window, offset] = *location;
+	auto const& read = reads[window];
+	if (offset + length > std::get<1>(plan.windows[window]) or not read.hasReplied(idx)) {
+		return std::nullopt;
+	}
+	return ByteSpan{read.getData(idx).data() + offset, length};
+}
+
+auto prepareRead(USB2Dynamixel const& usb2dyn, ReadPlan plan) -> PlannedRead {
+	PlannedRead planned;
+	for (auto const& [baseRegister, length] : plan.windows) {
+		if (usb2dyn.supportsSyncRead()) {
+			planned.reads.push_back(usb2dyn.prepareSyncRead(plan.motors, baseRegister, length));
+			continue;
+		}
+		std::vector<std::tuple<MotorID, int, std::size_t>> request;
+		for (auto motor : plan.motors) {
+			request.emplace_back(motor, baseRegister, length);
+		}
+		planned.reads.push_back(usb2dyn.prepareBulkRead(request));
+	}
+	planned.plan = std::move(plan);
+	return planned;
+}
+
+auto execute(USB2Dynamixel const& usb2dyn, PlannedRead& read, USB2Dynamixel::Timeout timeout) -> std::size_t {
+	for (auto& prepared : read.reads) {
+		usb2dyn.execute(prepared, timeout);
+	}
+	std::size_t complete {0};
+	for (std::size_t idx{0}; idx < read.plan.motors.size(); ++idx) {
+		complete += std::all_of(begin(read.reads), end(read.reads), [&](auto const& r) { return r.hasReplied(idx); });
+	}
+	return complete;
+}
+
+}
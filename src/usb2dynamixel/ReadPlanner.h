@@ -0,0 +1,76 @@
+#pragma once
+
+#include "USB2Dynamixel.h"
+
+#include <chrono>
+#include <cstddef>
+#include <optional>
+#include <tuple>
+#include <vector>
+
+namespace dynamixel {
+
+/**
+ * the time one read transaction of a register window from several motors takes on the bus
+ *
+ * a transaction is a bulk read (or sync read) request followed by one status packet per motor. Besides the transfer
+ * of these packets it waits for the return delay of every motor and the latency of the usb adapter.
+ */
+struct ReadCostModel {
+	Protocol protocol {Protocol::V1};
+	int baudrate {1000000};
+	bool syncRead {false};
+	std::chrono::nanoseconds overhead {0}; // fixed time of a transaction: adapter latency and return delays of all motors
+
+	[[nodiscard]] auto requestBytes(std::size_t numMotors) const -> std::size_t;
+	[[nodiscard]] auto replyBytes(std::size_t numMotors, std::size_t length) const -> std::size_t;
+	// longest window a single transaction can read (the status packet of protocol v1 has a one byte length field)
+	[[nodiscard]] auto maxLength() const -> std::size_t;
+	[[nodiscard]] auto estimate(std::size_t numMotors, std::size_t length) const -> std::chrono::nanoseconds;
+};
+
+// the cost model of reading from motors on the bus of usb2dyn, uses its latency and the return delays of the motors
+[[nodiscard]] auto makeCostModel(USB2Dynamixel const& usb2dyn, std::vector<MotorID> const& motors) -> ReadCostModel;
+
+/**
+ * the cheapest way to read a set of registers from motors of the same layout
+ *
+ * the registers are covered by one or more windows, every window is read from all motors with one transaction.
+ * A window that spans the gap between two registers transfers the gap bytes with every status packet, a separate window
+ * costs another request, more status packets and another round of return delays. planRead picks the partition with the
+ * lowest estimated time.
+ */
+struct ReadPlan {
+	std::vector<MotorID> motors;
+	std::vector<std::tuple<int, std::size_t>> windows; // [baseRegister, length] in ascending order
+	std::size_t wireBytes {0};                        // bytes of all requests and replies
+	std::chrono::nanoseconds estimatedTime {0};
+
+	// [window index, offset in the window] of the register reg, nullopt if it is not covered
+	[[nodiscard]] auto locate(int reg) const -> std::optional<std::tuple<std::size_t, std::size_t>>;
+};
+
+/**
+ * registers are [register, length] pairs, e.g. taken from MotorLayoutInfo::getInfos()
+ * throws if there are no motors or no registers
+ */
+[[nodiscard]] auto planRead(ReadCostModel const& model, std::vector<MotorID> const& motors, std::vector<std::tuple<int, std::size_t>> registers) -> ReadPlan;
+// the plan for the registers of layout given by their addresses, throws if a register is unknown
+[[nodiscard]] auto planRead(USB2Dynamixel const& usb2dyn, LayoutType layout, std::vector<MotorID> const& motors, std::vector<int> const& registers) -> ReadPlan;
+
+/**
+ * a read plan with one prepared read per window
+ */
+struct PlannedRead {
+	ReadPlan plan;
+	std::vector<PreparedRead> reads;
+
+	// the bytes of register reg (length bytes) of motors[idx], nullopt if it is not covered or the motor did not reply
+	[[nodiscard]] auto get(std::size_t idx, int reg, std::size_t length) const -> std::optional<ByteSpan>;
+};
+
+[[nodiscard]] auto prepareRead(USB2Dynamixel const& usb2dyn, ReadPlan plan) -> PlannedRead;
+// execute the reads of all windows, returns the number of motors that replied to every window
+auto execute(USB2Dynamixel const& usb2dyn, PlannedRead& read, USB2Dynamixel::Timeout timeout) -> std::size_t;
+
+}
@@ -0,0 +1,70 @@
+#include "RxBuffer.h"
+#include "file_io.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace dynamixel {
+
+RxBuffer::RxBuffer(std::size_t capacity)
+	: mBuffer(capacity)
+{}
+
+void RxBuffer::consume(std::size_t count) {
+	if (count > size()) {
+		throw std::runtime_error("cannot consume more bytes than are in the receive buffer");
+	}
+	mBegin += count;
+	if (mBegin == mEnd) {
+		mBegin = mEnd = 0;
+	}
+}
+
+void RxBuffer::clear() {
+	mBegin = mEnd = 0;
+}
+
+std::size_t RxBuffer::fill(int _fd) {
+	// move the unconsumed tail to the front if less than a quarter of the buffer is left
+	if (capacity() - mEnd < capacity() / 4 and mBegin > 0) {
+		std::memmove(mBuffer.data(), mBuffer.data() + mBegin, size());
+		mEnd  -= mBegin;
+		mBegin = 0;
+	}
+	auto bytesRead = file_io::read(_fd, mBuffer.data() + mEnd, capacity() - mEnd);
+	mEnd += bytesRead;
+	return bytesRead;
+}
+
+void RxBuffer::append(std::byte const* data, std::size_t count) {
+	if (capacity() - mEnd < count and mBegin > 0) {
+		std::memmove(mBuffer.data(), mBuffer.data() + mBegin, size());
+		mEnd  -= mBegin;
+		mBegin = 0;
+	}
+	if (capacity() - mEnd < count) {
+		throw std::runtime_error("receive buffer overflow");
+	}
+	std::memcpy(mBuffer.data() + mEnd, data, count);
+	mEnd += count;
+}
+
+bool RxBuffer::synchronize(std::byte const* marker, std::size_t markerSize) {
+	auto begin = data();
+	auto end   = begin + size();
+	auto iter  = std::search(begin, end, marker, marker + markerSize);
+	if (iter != end) {
+		consume(iter - begin);
+		return true;
+	}
+	// keep the longest suffix that is a prefix of the marker
+	std::size_t keep = std::min(markerSize-1, size());
+	while (keep > 0 and std::memcmp(end - keep, marker, keep) != 0) {
+		--keep;
+	}
+	consume(size() - keep);
+	return false;
+}
+
+}
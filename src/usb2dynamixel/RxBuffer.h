@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace dynamixel {
+
+/**
+ * receive buffer of a serial port
+ *
+ * bytes are read from the port into a buffer that is allocated once and consumed from its front.
+ * bytes that were not consumed (e.g. the beginning of the next packet) are kept for the next read.
+ * Whenever the free space at the end runs low the few unconsumed bytes are moved to the front,
+ * hence everything that is stored inside the buffer is contiguous and packets can be parsed in place.
+ */
+struct RxBuffer {
+	explicit RxBuffer(std::size_t capacity = 1<<17);
+
+	[[nodiscard]] auto data() -> std::byte* { return mBuffer.data() + mBegin; }
+	[[nodiscard]] auto size() const -> std::size_t { return mEnd - mBegin; }
+	[[nodiscard]] auto capacity() const -> std::size_t { return mBuffer.size(); }
+
+	// drop count bytes from the front, the dropped bytes stay valid until the next call to fill()
+	void consume(std::size_t count);
+	void clear();
+
+	// read whatever is available on _fd (without blocking) and return the number of newly received bytes
+	std::size_t fill(int _fd);
+	// append bytes that were received by other means, throws if they do not fit
+	void append(std::byte const* data, std::size_t count);
+
+	/**
+	 * drop everything in front of the first occurrence of marker
+	 * a partial marker at the very end is kept since the rest of it might not have arrived yet
+	 * returns true if the buffer starts with a complete marker
+	 */
+	bool synchronize(std::byte const* marker, std::size_t markerSize);
+
+private:
+	std::vector<std::byte> mBuffer;
+	std::size_t mBegin {0};
+	std::size_t mEnd {0};
+};
+
+}
@@ -0,0 +1,237 @@
+#include "SnapshotCache.h"
+
+#include "ReadPlanner.h"
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+
+namespace dynamixel {
+
+SnapshotCache::SnapshotCache(USB2Dynamixel const& usb2dyn, std::chrono::microseconds freshness)
+	: mUsb2dyn{usb2dyn}
+	, mFreshness{freshness}
+{}
+
+void SnapshotCache::addMotor(MotorID motor, LayoutType layout, std::vector<std::tuple<int, std::size_t>> const& registers) {
+	auto g = std::lock_guard(mMutex);
+	auto& layoutRegisters = mRegisters[layout];
+	for (auto const& r : registers) {
+		if (std::find(begin(layoutRegisters), end(layoutRegisters), r) == end(layoutRegisters)) {
+			layoutRegisters.push_back(r);
+		}
+	}
+	std::size_t tableSize {0};
+	for (auto const& [reg, length] : layoutRegisters) {
+		tableSize = std::max(tableSize, reg + length);
+	}
+	// motors of the layout that are already known need room for the new registers as well
+	for (auto& [id, snapshot] : mSnapshots) {
+		if (snapshot.layout == layout) {
+			snapshot.table.resize(tableSize);
+			snapshot.outdated = true;
+		}
+	}
+	mSnapshots[motor] = Snapshot{layout, Parameter(tableSize), Clock::time_point{}, false, true};
+}
+
+void SnapshotCache::removeMotor(MotorID motor) {
+	auto g = std::lock_guard(mMutex);
+	mSnapshots.erase(motor);
+}
+
+bool SnapshotCache::read(MotorID motor, int reg, std::size_t length, std::byte* out, Timeout timeout) {
+	auto lock = std::unique_lock(mMutex);
+	++mStats.reads;
+	auto iter = mSnapshots.find(motor);
+	auto covered = iter != mSnapshots.end() and reg >= 0 and reg + length <= iter->second.table.size();
+	if (covered) {
+		auto const& layoutRegisters = mRegisters.at(iter->second.layout);
+		covered = std::any_of(begin(layoutRegisters), end(layoutRegisters), [&](auto const& r) {
+			return std::get<0>(r) <= reg and reg + length <= std::get<0>(r) + std::get<1>(r);
+		});
+	}
+	if (not covered) {
+		++mStats.transactions;
+		lock.unlock();
+		auto [timeoutFlag, motorID, errorCode] = mUsb2dyn.read(motor, reg, out, length, timeout);
+		return not timeoutFlag and motorID == motor;
+	}
+
+	if (not isOutdated(iter->second, Clock::now())) {
+		++mStats.hits;
+	} else {
+		// queue the motor and wait for the refresh that serves it, if nobody is refreshing this thread does it
+		auto generation = iter->second.generation;
+		auto failures   = iter->second.failures;
+		while (true) {
+			iter = mSnapshots.find(motor);
+			if (iter == mSnapshots.end() or iter->second.failures != failures) {
+				return false;
+			}
+			if (iter->second.generation != generation) {
+				break;
+			}
+			// a refresh clears the queue, the motor is queued again for every attempt
+			mQueued.insert(motor);
+			if (mBusy) {
+				mRefreshed.wait(lock);
+			} else {
+				refresh(lock, timeout);
+			}
+		}
+	}
+	auto const& snapshot = iter->second;
+	if (not snapshot.valid or reg + length > snapshot.table.size()) {
+		return false;
+	}
+	std::memcpy(out, snapshot.table.data() + reg, length);
+	return true;
+}
+
+auto SnapshotCache::snapshotAll(Timeout timeout) -> std::map<MotorID, Parameter> {
+	auto lock = std::unique_lock(mMutex);
+	// [generation, failures] of every outdated motor, it is waited for until one of them changed
+	std::map<MotorID, std::tuple<uint64_t, uint64_t>> outdated;
+	auto now = Clock::now();
+	for (auto const& [id, snapshot] : mSnapshots) {
+		if (isOutdated(snapshot, now)) {
+			outdated.emplace(id, std::tuple{snapshot.generation, snapshot.failures});
+		}
+	}
+	std::set<MotorID> failed;
+	while (true) {
+		for (auto iter = outdated.begin(); iter != outdated.end();) {
+			auto snapshot = mSnapshots.find(iter->first);
+			auto const& [generation, failures] = iter->second;
+			if (snapshot == mSnapshots.end() or snapshot->second.generation != generation) {
+				iter = outdated.erase(iter);
+			} else if (snapshot->second.failures != failures) {
+				failed.insert(iter->first);
+				iter = outdated.erase(iter);
+			} else {
+				++iter;
+			}
+		}
+		if (outdated.empty()) {
+			break;
+		}
+		// a refresh clears the queue, the motors are queued again for every attempt
+		for (auto const& [id, state] : outdated) {
+			mQueued.insert(id);
+		}
+		if (mBusy) {
+			mRefreshed.wait(lock);
+		} else {
+			refresh(lock, timeout);
+		}
+	}
+
+	std::map<MotorID, Parameter> tables;
+	for (auto const& [id, snapshot] : mSnapshots) {
+		if (snapshot.valid and failed.count(id) == 0) {
+			tables.emplace(id, snapshot.table);
+		}
+	}
+	return tables;
+}
+
+void SnapshotCache::invalidate(MotorID motor) {
+	auto g = std::lock_guard(mMutex);
+	auto iter = mSnapshots.find(motor);
+	if (iter != mSnapshots.end()) {
+		iter->second.outdated = true;
+	}
+}
+
+auto SnapshotCache::getStats() const -> Stats {
+	auto g = std::lock_guard(mMutex);
+	return mStats;
+}
+
+void SnapshotCache::refresh(std::unique_lock<std::mutex>& lock, Timeout timeout) {
+	auto now = Clock::now();
+	std::set<LayoutType> layouts;
+	for (auto motor : mQueued) {
+		auto iter = mSnapshots.find(motor);
+		if (iter != mSnapshots.end() and isOutdated(iter->second, now)) {
+			layouts.insert(iter->second.layout);
+		}
+	}
+	mQueued.clear();
+
+	// every layout is read with its own plan, outdated motors that nobody asked for are refreshed along
+	std::vector<PlannedRead> reads;
+	for (auto layout : layouts) {
+		std::vector<MotorID> motors;
+		for (auto& [id, snapshot] : mSnapshots) {
+			if (snapshot.layout == layout and isOutdated(snapshot, now)) {
+				motors.push_back(id);
+			}
+		}
+		auto plan = planRead(makeCostModel(mUsb2dyn, motors), motors, mRegisters.at(layout));
+		reads.push_back(prepareRead(mUsb2dyn, std::move(plan)));
+	}
+	// an invalidate while the bus is in use marks the snapshot outdated again
+	for (auto const& read : reads) {
+		for (auto motor : read.plan.motors) {
+			mSnapshots.at(motor).outdated = false;
+		}
+	}
+
+	mBusy = true;
+	lock.unlock();
+	std::exception_ptr error;
+	try {
+		for (auto& read : reads) {
+			execute(mUsb2dyn, read, timeout);
+		}
+	} catch (...) {
+		error = std::current_exception();
+	}
+	lock.lock();
+
+	for (auto const& read : reads) {
+		for (std::size_t idx{0}; idx < read.plan.motors.size(); ++idx) {
+			// the motor may have been removed or added again while the bus was in use
+			auto iter = mSnapshots.find(read.plan.motors[idx]);
+			if (iter == mSnapshots.end()) {
+				continue;
+			}
+			auto& snapshot = iter->second;
+			if (error) {
+				snapshot.outdated = true;
+				++snapshot.failures;
+				continue;
+			}
+			snapshot.valid = true;
+			for (std::size_t window{0}; window < read.reads.size(); ++window) {
+				auto const& prepared = read.reads[window];
+				auto const& [baseRegister, length] = read.plan.windows[window];
+				if (not prepared.hasReplied(idx) or baseRegister + length > snapshot.table.size()) {
+					snapshot.valid = false;
+					continue;
+				}
+				auto data = prepared.getData(idx);
+				std::copy(data.begin(), data.end(), snapshot.table.begin() + baseRegister);
+			}
+			// a motor that did not reply is not asked again before freshness has passed
+			snapshot.lastRefresh = now;
+			++snapshot.generation;
+		}
+		mStats.transactions += read.reads.size();
+		mStats.refreshes    += read.plan.motors.size();
+	}
+	++mStats.batches;
+	if (error) {
+		++mStats.failedBatches;
+	}
+	mBusy = false;
+	mRefreshed.notify_all();
+	if (error) {
+		std::rethrow_exception(error);
+	}
+}
+
+}
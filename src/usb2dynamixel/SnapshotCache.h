@@ -0,0 +1,95 @@
+#pragma once
+
+#include "USB2Dynamixel.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <set>
+#include <tuple>
+#include <vector>
+
+namespace dynamixel {
+
+/**
+ * a snapshot of the registers of every motor that serves many small reads with few bus transactions
+ *
+ * a read of a register is answered from the snapshot of its motor if that is younger than freshness. Otherwise
+ * the snapshots of all outdated motors of the same layout are refreshed together: the registers of the layout are
+ * covered by the windows of a read plan (see planRead) and every window is read from all these motors at once.
+ * Reading 30 registers of 20 motors thus costs a handful of transactions instead of 600.
+ * Motors that do not reply are not asked again until freshness has passed.
+ *
+ * read can be called from many threads. Only one of them talks to the bus at a time, the others queue the motors
+ * they need and are served by the next refresh, which covers everything that was queued while the bus was busy.
+ * Reads of up to date snapshots do not wait for the bus.
+ */
+struct SnapshotCache {
+	using Clock   = std::chrono::steady_clock;
+	using Timeout = USB2Dynamixel::Timeout;
+
+	SnapshotCache(USB2Dynamixel const& usb2dyn, std::chrono::microseconds freshness);
+
+	// registers [register, length] that are kept in the snapshot of motor, motors of the same layout share their registers
+	void addMotor(MotorID motor, LayoutType layout, std::vector<std::tuple<int, std::size_t>> const& registers);
+	void removeMotor(MotorID motor);
+
+	/**
+	 * copy the register [reg, reg + length) of motor to out, refreshes the snapshot first if it is outdated
+	 * registers that are not part of the snapshot are read directly, returns false if the motor did not reply
+	 * or the refresh of another thread that this read waited for failed (the refreshing thread gets the exception)
+	 */
+	bool read(MotorID motor, int reg, std::size_t length, std::byte* out, Timeout timeout);
+	/**
+	 * copy the snapshots (the registers starting at address 0) of all motors at once, outdated snapshots are refreshed first
+	 * motors that did not reply are left out, as are motors whose refresh by another thread failed
+	 */
+	auto snapshotAll(Timeout timeout) -> std::map<MotorID, Parameter>;
+	// the next read of motor refreshes its snapshot (e.g. after a write)
+	void invalidate(MotorID motor);
+
+	[[nodiscard]] auto getFreshness() const -> std::chrono::microseconds { return mFreshness; }
+
+	struct Stats {
+		int64_t reads {0};        // calls of read
+		int64_t hits {0};         // reads served from an up to date snapshot
+		int64_t refreshes {0};    // snapshots refreshed
+		int64_t transactions {0}; // bus transactions of all refreshes and direct reads
+		int64_t batches {0};      // refreshes of all queued motors, one batch serves the reads of several threads
+		int64_t failedBatches {0}; // batches whose bus transactions threw
+	};
+	[[nodiscard]] auto getStats() const -> Stats;
+
+private:
+	struct Snapshot {
+		LayoutType layout;
+		Parameter table;               // the registers starting at address 0
+		Clock::time_point lastRefresh;
+		bool valid {false};            // the motor replied to the last refresh
+		bool outdated {true};          // refresh on the next read regardless of freshness
+		uint64_t generation {0};       // counts the refreshes, a queued read waits until it changes
+		uint64_t failures {0};         // counts the refreshes that failed (the bus threw), a queued read then gives up
+	};
+
+	// refresh all outdated motors of the layouts of the queued motors, releases lock while the bus is in use
+	void refresh(std::unique_lock<std::mutex>& lock, Timeout timeout);
+	[[nodiscard]] bool isOutdated(Snapshot const& snapshot, Clock::time_point now) const {
+		return snapshot.outdated or now - snapshot.lastRefresh >= mFreshness;
+	}
+
+	USB2Dynamixel const& mUsb2dyn;
+	std::chrono::microseconds mFreshness;
+
+	mutable std::mutex mMutex;
+	std::map<MotorID, Snapshot> mSnapshots;
+	std::map<LayoutType, std::vector<std::tuple<int, std::size_t>>> mRegisters; // union of the registers of all motors of a layout
+	Stats mStats;
+
+	std::set<MotorID> mQueued;           // motors whose reads wait for the next refresh
+	bool mBusy {false};                  // a thread is refreshing
+	std::condition_variable mRefreshed;
+};
+
+}
@@ -1,5 +1,6 @@
 #include "USB2Dynamixel.h"
 
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
 
@@ -15,9 +16,12 @@
 namespace dynamixel {
 
 USB2Dynamixel::USB2Dynamixel(int baudrate, std::string const& device, Protocol protocol)
-	: mPort(device, baudrate)
+	: mProtocolVersion(protocol)
+	, mBaudrate(baudrate)
+	, mPort(device, baudrate)
 {
 	file_io::flushRead(mPort);
+	mReturnDelays.fill(std::chrono::microseconds{508});
 	if (protocol == Protocol::V1) {
 		mProtocol = std::make_unique<ProtocolV1>();
 	} else {
@@ -30,57 +34,201 @@ USB2Dynamixel::~USB2Dynamixel() {
 
 bool USB2Dynamixel::ping(MotorID motor, Timeout timeout) const {
 	auto g = std::lock_guard(mMutex);
-	file_io::write(mPort, mProtocol->createPacket(motor, Instruction::PING, {}));
-	auto [timeoutFlag, motorID, errorCode, rxBuf] = mProtocol->readPacket(timeout, motor, 0, mPort);
+	transmit(motor, Instruction::PING, {});
+	// a protocol v2 ping is answered with the model number and the firmware version
+	std::size_t numParameters = mProtocolVersion == Protocol::V2 ? 3 : 0;
+	auto [timeoutFlag, motorID, errorCode, rxBuf] = receive(motor, numParameters, resolveTimeout(timeout, 0, numParameters, motor));
 	return motorID != MotorIDInvalid;
 }
 
-auto USB2Dynamixel::read(MotorID motor, int baseRegister, size_t length, Timeout timeout) const -> std::tuple<bool, MotorID, ErrorCode, Parameter> {
-	std::vector<std::byte> txBuf;
-	for (auto b : mProtocol->convertAddress(baseRegister)) {
-		txBuf.push_back(b);
+auto USB2Dynamixel::broadcast_ping(Timeout window) const -> std::vector<std::tuple<MotorID, uint16_t>> {
+	if (mProtocolVersion != Protocol::V2) {
+		throw std::runtime_error("broadcast_ping: only available in protocol v2");
 	}
-	for (auto b : mProtocol->convertLength(length)) {
-		txBuf.push_back(b);
+	std::vector<std::tuple<MotorID, uint16_t>> motors;
+
+	auto g = std::lock_guard(mMutex);
+	if (window == AutoTimeout) {
+		// motors answer one after another, leave room for every id
+		auto maxReturnDelay = *std::max_element(begin(mReturnDelays), end(mReturnDelays));
+		window = std::chrono::duration_cast<Timeout>(getTransferTime(mProtocol->instructionPacketSize(0))
+			+ getTransferTime(mProtocol->statusPacketSize(3) * 0xFD) * 3 / 2 + maxReturnDelay + latencyMargin());
 	}
+	transmit(BroadcastID, Instruction::PING, {});
+	auto deadline = std::chrono::high_resolution_clock::now() + window;
+	measureReception([&] {
+		while (true) {
+			auto remaining = std::chrono::duration_cast<Timeout>(deadline - std::chrono::high_resolution_clock::now());
+			if (remaining.count() <= 0) {
+				break;
+			}
+			auto [timeoutFlag, motorID, errorCode, rxBuf] = mProtocol->receivePacket(remaining, BroadcastID, 3, mPort, mRxBuffer);
+			if (timeoutFlag) {
+				break;
+			}
+			bool known = std::any_of(begin(motors), end(motors), [id=motorID](auto const& m) { return std::get<0>(m) == id; });
+			if (not known) {
+				motors.emplace_back(motorID, uint16_t(std::to_integer<uint16_t>(rxBuf[0]) | (std::to_integer<uint16_t>(rxBuf[1]) << 8)));
+			}
+		}
+		return motors.size();
+	});
+	return motors;
+}
+
+auto USB2Dynamixel::read(MotorID motor, int baseRegister, size_t length, Timeout timeout) const -> std::tuple<bool, MotorID, ErrorCode, Parameter> {
+	Parameter rxBuf(length);
+	auto [timeoutFlag, motorID, errorCode] = read(motor, baseRegister, rxBuf.data(), length, timeout);
+	if (timeoutFlag or motorID == MotorIDInvalid) {
+		rxBuf.clear();
+	}
+	return std::make_tuple(timeoutFlag, motorID, errorCode, std::move(rxBuf));
+}
+
+auto USB2Dynamixel::read(MotorID motor, int baseRegister, std::byte* out, size_t length, Timeout timeout) const -> std::tuple<bool, MotorID, ErrorCode> {
+	std::array<std::byte, 4> request;
+	auto requestSize = mProtocol->writeAddress(baseRegister, request.data());
+	requestSize += mProtocol->writeLength(length, request.data() + requestSize);
 
 	auto g = std::lock_guard(mMutex);
-	file_io::write(mPort, mProtocol->createPacket(motor, Instruction::READ, txBuf));
-	return mProtocol->readPacket(timeout, motor, length, mPort);
+	transmit(motor, Instruction::READ, {ByteSpan{request.data(), requestSize}});
+	auto [timeoutFlag, motorID, errorCode, rxBuf] = receive(motor, length, resolveTimeout(timeout, requestSize, length, motor));
+	if (not timeoutFlag and motorID != MotorIDInvalid) {
+		std::memcpy(out, rxBuf.data(), rxBuf.size());
+	}
+	return std::make_tuple(timeoutFlag, motorID, errorCode);
 }
 
-auto USB2Dynamixel::bulk_read(std::vector<std::tuple<MotorID, int, size_t>> const& motors, Timeout timeout) const -> std::vector<std::tuple<MotorID, int, ErrorCode, Parameter>> {
+auto USB2Dynamixel::bulk_read(std::vector<std::tuple<MotorID, int, size_t>> const& motors, Timeout timeout) const -> std::vector<std::tuple<bool, MotorID, int, ErrorCode, Parameter>> {
+	auto prepared = prepareBulkRead(motors);
+	execute(prepared, timeout);
 
-	std::vector<std::tuple<MotorID, int, ErrorCode, Parameter>> resList;
+	std::vector<std::tuple<bool, MotorID, int, ErrorCode, Parameter>> resList;
 	resList.reserve(motors.size());
+	for (std::size_t idx{0}; idx < motors.size(); ++idx) {
+		auto const& [id, baseRegister, length] = motors[idx];
+		if (prepared.hasReplied(idx)) {
+			auto data = prepared.getData(idx);
+			resList.emplace_back(false, id, baseRegister, prepared.getErrorCode(idx), Parameter(data.begin(), data.end()));
+		} else {
+			resList.emplace_back(true, id, baseRegister, ErrorCode{}, Parameter{});
+		}
+	}
+	return resList;
+}
 
-	auto txBuf = mProtocol->buildBulkReadPackage(motors);
+auto USB2Dynamixel::sync_read(std::vector<MotorID> const& motors, int baseRegister, size_t length, Timeout timeout) const -> std::vector<std::tuple<bool, MotorID, ErrorCode, Parameter>> {
+	auto prepared = prepareSyncRead(motors, baseRegister, length);
+	execute(prepared, timeout);
 
-	auto g = std::lock_guard(mMutex);
-	file_io::write(mPort, mProtocol->createPacket(BroadcastID, Instruction::BULK_READ, txBuf));
+	std::vector<std::tuple<bool, MotorID, ErrorCode, Parameter>> resList;
+	resList.reserve(motors.size());
+	for (std::size_t idx{0}; idx < motors.size(); ++idx) {
+		if (prepared.hasReplied(idx)) {
+			auto data = prepared.getData(idx);
+			resList.emplace_back(false, motors[idx], prepared.getErrorCode(idx), Parameter(data.begin(), data.end()));
+		} else {
+			resList.emplace_back(true, motors[idx], ErrorCode{}, Parameter{});
+		}
+	}
+	return resList;
+}
 
+auto USB2Dynamixel::prepareBulkRead(std::vector<std::tuple<MotorID, int, size_t>> const& motors) const -> PreparedRead {
+	PreparedRead read;
+	read.motors = motors;
+	read.instruction = Instruction::BULK_READ;
+	auto parameters = mProtocol->buildBulkReadPackage(motors);
+	read.numRequestParameters = parameters.size();
+	read.packet = mProtocol->createPacket(BroadcastID, read.instruction, std::move(parameters));
+
+	read.replied.resize(motors.size(), false);
+	read.errorCodes.resize(motors.size());
+	read.offsets.reserve(motors.size());
+	std::size_t size {0};
 	for (auto const& [id, baseRegister, length] : motors) {
-		auto [timeoutFlag, motorID, errorCode, rxBuf] = mProtocol->readPacket(timeout, id, length, mPort);
-		if (motorID == MotorIDInvalid or motorID != id) {
-			break;
+		read.offsets.push_back(size);
+		size += length;
+	}
+	read.data.resize(size);
+	return read;
+}
+
+auto USB2Dynamixel::prepareSyncRead(std::vector<MotorID> const& motors, int baseRegister, size_t length) const -> PreparedRead {
+	if (not supportsSyncRead()) {
+		throw std::runtime_error("sync read is only available in protocol v2");
+	}
+	PreparedRead read;
+	read.instruction = Instruction::SYNC_READ;
+	auto parameters = mProtocol->buildSyncReadPackage(motors, baseRegister, length);
+	read.numRequestParameters = parameters.size();
+	read.packet = mProtocol->createPacket(BroadcastID, read.instruction, std::move(parameters));
+
+	read.motors.reserve(motors.size());
+	read.offsets.reserve(motors.size());
+	for (auto id : motors) {
+		read.offsets.push_back(read.motors.size() * length);
+		read.motors.emplace_back(id, baseRegister, length);
+	}
+	read.replied.resize(motors.size(), false);
+	read.errorCodes.resize(motors.size());
+	read.data.resize(motors.size() * length);
+	return read;
+}
+
+auto USB2Dynamixel::execute(PreparedRead& read, Timeout timeout) const -> std::size_t {
+	return executeInto(read, nullptr, 0, timeout);
+}
+
+auto USB2Dynamixel::executeInto(PreparedRead& read, std::byte* destination, std::size_t stride, Timeout timeout) const -> std::size_t {
+	std::fill(begin(read.replied), end(read.replied), false);
+	read.numReplies = 0;
+	if (read.motors.empty()) {
+		return 0;
+	}
+	if (destination) {
+		bool fits = std::all_of(begin(read.motors), end(read.motors), [&](auto const& m) { return std::get<2>(m) == stride; });
+		if (not fits) {
+			throw std::runtime_error("execute: the prepared read does not match the size of the layouts");
 		}
-		resList.push_back(std::make_tuple(id, baseRegister, errorCode, rxBuf));
 	}
-	return resList;
+
+	auto g = std::lock_guard(mMutex);
+	if (timeout == AutoTimeout) {
+		// the timeout applies between two replies, use the slowest motor
+		Timeout slowest {0};
+		for (auto const& [id, baseRegister, length] : read.motors) {
+			slowest = std::max(slowest, resolveTimeout(timeout, read.numRequestParameters, length, id));
+		}
+		timeout = slowest;
+	}
+	transmit(read.packet);
+
+	read.numReplies = measureReception([&] {
+		return mProtocol->receivePackets(timeout, read.motors, mPort, mRxBuffer, [&](std::size_t idx, ErrorCode errorCode, ByteSpan payload) {
+			read.replied[idx] = true;
+			read.errorCodes[idx] = errorCode;
+			auto target = destination ? destination + idx * stride : read.data.data() + read.offsets[idx];
+			std::memcpy(target, payload.data(), payload.size());
+		});
+	});
+	return read.numReplies;
 }
 
 void USB2Dynamixel::write(MotorID motor, int baseRegister, Parameter const& txBuf) const {
-	std::vector<std::byte> parameters;
-	for (auto b : mProtocol->convertAddress(baseRegister)) {
-		parameters.push_back(b);
-	}
-	parameters.insert(parameters.end(), txBuf.begin(), txBuf.end());
+	std::array<std::byte, 2> address;
+	auto addressSize = mProtocol->writeAddress(baseRegister, address.data());
 	auto g = std::lock_guard(mMutex);
-	file_io::write(mPort, mProtocol->createPacket(motor, Instruction::WRITE, parameters));
+	transmit(motor, Instruction::WRITE, {ByteSpan{address.data(), addressSize}, ByteSpan{txBuf.data(), txBuf.size()}});
 }
 auto USB2Dynamixel::writeRead(MotorID motor, int baseRegister, Parameter const& txBuf, Timeout timeout) const -> std::tuple<bool, MotorID, ErrorCode, Parameter> {
-	write(motor, baseRegister, txBuf);
-	return mProtocol->readPacket(timeout, motor, 0, mPort);
+	std::array<std::byte, 2> address;
+	auto addressSize = mProtocol->writeAddress(baseRegister, address.data());
+	// one lock for request and reply, otherwise another thread may transmit in between and take the reply
+	auto g = std::lock_guard(mMutex);
+	transmit(motor, Instruction::WRITE, {ByteSpan{address.data(), addressSize}, ByteSpan{txBuf.data(), txBuf.size()}});
+	auto [timeoutFlag, motorID, errorCode, rxBuf] = receive(motor, 0, resolveTimeout(timeout, addressSize + txBuf.size(), 0, motor));
+	return std::make_tuple(timeoutFlag, motorID, errorCode, Parameter(rxBuf.begin(), rxBuf.end()));
 }
 
 
@@ -113,18 +261,256 @@ void USB2Dynamixel::sync_write(std::map<MotorID, Parameter> const& motorParams,
 		txBuf.insert(txBuf.end(), params.begin(), params.end());
 	}
 
-	file_io::write(mPort, mProtocol->createPacket(BroadcastID, Instruction::SYNC_WRITE, txBuf));
+	transmit(mProtocol->createPacket(BroadcastID, Instruction::SYNC_WRITE, txBuf));
+}
+
+auto USB2Dynamixel::prepareSyncWrite(std::vector<MotorID> const& motors, int baseRegister, std::size_t length) const -> SyncWritePacket {
+	if (motors.empty() or length == 0) {
+		throw std::runtime_error("prepareSyncWrite: need motors and data to write");
+	}
+	SyncWritePacket packet {motors, baseRegister, length, {}, 0};
+
+	Parameter parameters(4);
+	auto prefixSize = mProtocol->writeAddress(baseRegister, parameters.data());
+	prefixSize += mProtocol->writeLength(length, parameters.data() + prefixSize);
+	parameters.resize(prefixSize + motors.size() * (length + 1));
+	for (std::size_t idx{0}; idx < motors.size(); ++idx) {
+		parameters[prefixSize + idx * (length + 1)] = std::byte{motors[idx]};
+	}
+	auto numParameters = parameters.size();
+	packet.packet = mProtocol->createPacket(BroadcastID, Instruction::SYNC_WRITE, std::move(parameters));
+	if (packet.packet.size() != mProtocol->instructionPacketSize(numParameters)) {
+		throw std::runtime_error("prepareSyncWrite: the packet cannot be patched in place");
+	}
+	packet.dataOffset = mProtocol->parameterOffset() + prefixSize;
+	return packet;
+}
+
+void USB2Dynamixel::sync_write(SyncWritePacket& packet) const {
+	auto g = std::lock_guard(mMutex);
+	if (mProtocol->updateChecksum(packet.packet)) {
+		transmit(packet.packet);
+		return;
+	}
+	// the data needs byte stuffing, build a fresh packet (the prepared one stays as it is)
+	auto trailerSize = mProtocol->instructionPacketSize(0) - mProtocol->parameterOffset();
+	Parameter parameters(std::next(packet.packet.begin(), mProtocol->parameterOffset()), std::prev(packet.packet.end(), trailerSize));
+	transmit(mProtocol->createPacket(BroadcastID, Instruction::SYNC_WRITE, std::move(parameters)));
+}
+
+void USB2Dynamixel::bulk_write(std::vector<std::tuple<MotorID, int, Parameter>> const& motors) const {
+	if (motors.empty()) {
+		throw std::runtime_error("bulk_write: motors can't be empty");
+	}
+
+	auto g = std::lock_guard(mMutex);
+	if (mProtocolVersion == Protocol::V2) {
+		transmit(mProtocol->createPacket(BroadcastID, Instruction::BULK_WRITE, mProtocol->buildBulkWritePackage(motors)));
+		return;
+	}
+	for (auto const& [id, baseRegister, data] : motors) {
+		Parameter parameters = mProtocol->convertAddress(baseRegister);
+		parameters.insert(parameters.end(), data.begin(), data.end());
+		transmit(mProtocol->createPacket(id, Instruction::WRITE, parameters));
+	}
+}
+
+void USB2Dynamixel::reg_write(MotorID motor, int baseRegister, Parameter const& txBuf) const {
+	std::array<std::byte, 2> address;
+	auto addressSize = mProtocol->writeAddress(baseRegister, address.data());
+	auto g = std::lock_guard(mMutex);
+	transmit(motor, Instruction::REG_WRITE, {ByteSpan{address.data(), addressSize}, ByteSpan{txBuf.data(), txBuf.size()}});
+}
+
+void USB2Dynamixel::action(MotorID motor) const {
+	auto g = std::lock_guard(mMutex);
+	transmit(motor, Instruction::ACTION, {});
+}
+
+auto USB2Dynamixel::staged_write(std::vector<std::tuple<MotorID, int, Parameter>> const& motors) const -> std::chrono::nanoseconds {
+	if (motors.empty()) {
+		throw std::runtime_error("staged_write: motors can't be empty");
+	}
+
+	// build all packets up front so that building them does not add to the skew
+	std::vector<Parameter> packets;
+	packets.reserve(motors.size());
+	for (auto const& [id, baseRegister, data] : motors) {
+		Parameter parameters = mProtocol->convertAddress(baseRegister);
+		parameters.insert(parameters.end(), data.begin(), data.end());
+		packets.emplace_back(mProtocol->createPacket(id, Instruction::REG_WRITE, parameters));
+	}
+	auto actionPacket = mProtocol->createPacket(BroadcastID, Instruction::ACTION, {});
+
+	auto g = std::lock_guard(mMutex);
+	auto start = std::chrono::high_resolution_clock::now();
+	for (auto const& packet : packets) {
+		transmit(packet);
+	}
+	transmit(actionPacket);
+	// write() returns once the kernel buffered the data, wait until the ACTION actually left the adapter
+	file_io::drain(mPort);
+	return std::chrono::high_resolution_clock::now() - start;
 }
 
 void USB2Dynamixel::reset(MotorID motor) const {
 	auto g = std::lock_guard(mMutex);
-	file_io::write(mPort, mProtocol->createPacket(motor, Instruction::RESET, {}));
+	transmit(motor, Instruction::RESET, {});
 
 }
 
 void USB2Dynamixel::reboot(MotorID motor) const {
 	auto g = std::lock_guard(mMutex);
-	file_io::write(mPort, mProtocol->createPacket(motor, Instruction::REBOOT, {}));
+	transmit(motor, Instruction::REBOOT, {});
+}
+
+auto USB2Dynamixel::estimateTimeout(std::size_t requestParameters, std::size_t responseParameters, MotorID motor) const -> Timeout {
+	auto g = std::lock_guard(mMutex);
+	return resolveTimeout(AutoTimeout, requestParameters, responseParameters, motor);
+}
+
+void USB2Dynamixel::setReturnDelay(MotorID motor, std::chrono::microseconds returnDelay) {
+	auto g = std::lock_guard(mMutex);
+	mReturnDelays[motor] = returnDelay;
+	mReturnDelayKnown.set(motor);
+}
+
+auto USB2Dynamixel::getReturnDelay(MotorID motor) const -> std::chrono::nanoseconds {
+	auto g = std::lock_guard(mMutex);
+	return mReturnDelays[motor];
+}
+
+bool USB2Dynamixel::calibrateReturnDelay(MotorID motor, LayoutType layout, Timeout timeout) {
+	int returnDelayRegister = 0;
+	switch (layout) {
+		case LayoutType::MX_V1:
+		case LayoutType::XL320:
+		case LayoutType::AX:
+			returnDelayRegister = int(mx_v1::Register::RETURN_DELAY_TIME);
+			break;
+		case LayoutType::MX_V2:
+		case LayoutType::Pro:
+			returnDelayRegister = int(mx_v2::Register::RETURN_DELAY_TIME);
+			break;
+		default:
+			return false;
+	}
+	auto [timeoutFlag, motorID, errorCode, rxBuf] = read(motor, returnDelayRegister, 1, timeout);
+	if (timeoutFlag or motorID == MotorIDInvalid) {
+		return false;
+	}
+	// the register counts in units of 2us
+	setReturnDelay(motor, std::chrono::microseconds{2 * std::to_integer<int>(rxBuf.at(0))});
+	return true;
+}
+
+void USB2Dynamixel::setBaudrate(int baudrate) {
+	auto g = std::lock_guard(mMutex);
+	mBaudrate = baudrate;
+	mPort.setBaudrate(baudrate);
+	file_io::flushRead(mPort);
+	mRxBuffer.clear();
+}
+
+void USB2Dynamixel::setLatency(std::chrono::microseconds latency) {
+	auto g = std::lock_guard(mMutex);
+	mLatency = latency;
+	mLatencyDeviation = std::chrono::nanoseconds{0};
+	mLatencySampled = false;
+}
+
+auto USB2Dynamixel::getLatency() const -> std::chrono::nanoseconds {
+	auto g = std::lock_guard(mMutex);
+	return mLatency;
+}
+
+void USB2Dynamixel::setLearnLatency(bool learn) {
+	auto g = std::lock_guard(mMutex);
+	mLearnLatency = learn;
+}
+
+auto USB2Dynamixel::getReceptionStats() const -> ReceptionStats {
+	auto g = std::lock_guard(mMutex);
+	return mReceptionStats;
+}
+
+void USB2Dynamixel::transmit(Parameter const& packet) const {
+	mRxBuffer.clear();
+	mLastTransmitTime = std::chrono::high_resolution_clock::now();
+	mLastTransmitSize = packet.size();
+	file_io::write(mPort, packet);
+}
+
+void USB2Dynamixel::transmit(MotorID motor, Instruction instr, std::initializer_list<ByteSpan> parameters) const {
+	ProtocolBase::PacketFrame frame;
+	if (not mProtocol->framePacket(motor, instr, parameters.begin(), parameters.size(), frame)) {
+		// byte stuffing is needed, that does not work without copying the parameters
+		Parameter data;
+		for (auto const& piece : parameters) {
+			data.insert(data.end(), piece.begin(), piece.end());
+		}
+		transmit(mProtocol->createPacket(motor, instr, std::move(data)));
+		return;
+	}
+
+	std::array<struct iovec, 8> iov;
+	assert(parameters.size() + 2 <= iov.size());
+	int iovcnt {0};
+	std::size_t packetSize {0};
+	auto add = [&](std::byte const* data, std::size_t size) {
+		if (size > 0) {
+			iov[iovcnt++] = {const_cast<std::byte*>(data), size};
+			packetSize += size;
+		}
+	};
+	add(frame.header.data(), frame.headerSize);
+	for (auto const& piece : parameters) {
+		add(piece.data(), piece.size());
+	}
+	add(frame.trailer.data(), frame.trailerSize);
+
+	mRxBuffer.clear();
+	mLastTransmitTime = std::chrono::high_resolution_clock::now();
+	mLastTransmitSize = packetSize;
+	file_io::write(mPort, iov.data(), iovcnt);
+}
+
+auto USB2Dynamixel::receive(MotorID expectedMotorID, std::size_t numParameters, Timeout timeout) const -> std::tuple<bool, MotorID, ErrorCode, ByteSpan> {
+	auto result = measureReception([&] {
+		return mProtocol->receivePacket(timeout, expectedMotorID, numParameters, mPort, mRxBuffer);
+	});
+	auto const& [timeoutFlag, motorID, errorCode, payload] = result;
+	if (mLearnLatency and not timeoutFlag and motorID != MotorIDInvalid and mReturnDelayKnown.test(motorID)) {
+		// whatever the wire time and the return delay do not explain is latency
+		auto elapsed  = std::chrono::high_resolution_clock::now() - mLastTransmitTime;
+		auto expected = getTransferTime(mLastTransmitSize + mProtocol->statusPacketSize(numParameters)) + mReturnDelays[motorID];
+		auto observed = std::max(std::chrono::nanoseconds{0}, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed) - expected);
+		if (not mLatencySampled) {
+			mLatency = observed;
+			mLatencyDeviation = observed / 2;
+			mLatencySampled = true;
+		} else {
+			auto error = observed - mLatency;
+			mLatency += error / 8;
+			mLatencyDeviation += (std::chrono::abs(error) - mLatencyDeviation) / 4;
+		}
+	}
+	return result;
+}
+
+auto USB2Dynamixel::latencyMargin() const -> std::chrono::nanoseconds {
+	// scheduling of the calling thread needs some slack even if the adapter is fast
+	return std::max(std::chrono::nanoseconds{std::chrono::microseconds{100}}, mLatency + 4 * mLatencyDeviation);
+}
+
+auto USB2Dynamixel::resolveTimeout(Timeout timeout, std::size_t requestParameters, std::size_t responseParameters, MotorID motor) const -> Timeout {
+	if (timeout != AutoTimeout) {
+		return timeout;
+	}
+	auto wireTime = getTransferTime(mProtocol->instructionPacketSize(requestParameters) + mProtocol->statusPacketSize(responseParameters));
+	auto returnDelay = motor == BroadcastID ? *std::max_element(begin(mReturnDelays), end(mReturnDelays)) : mReturnDelays[motor];
+	// round up, a timeout of zero would mean to wait forever
+	return std::chrono::ceil<Timeout>(wireTime + returnDelay + latencyMargin());
 }
 
 }
@@ -2,16 +2,23 @@
 
 #include "dynamixel.h"
 #include "ProtocolBase.h"
+#include "RxBuffer.h"
 #include <simplyfile/SerialPort.h>
+#include <simplyfile/ThreadTime.h>
 
+#include <array>
+#include <bitset>
 #include <cassert>
 #include <chrono>
 #include <cstring>
+#include <initializer_list>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <set>
+#include <stdexcept>
 #include <string>
+#include <type_traits>
 
 #include "Layout.h"
 
@@ -24,36 +31,206 @@ enum class Protocol : int {
 	V2 = 2,
 };
 
+/**
+ * a SYNC_WRITE to a fixed set of motors and a fixed register window that is sent over and over again
+ * the packet is built once by USB2Dynamixel::prepareSyncWrite, set() patches the data of a motor in place
+ * and USB2Dynamixel::sync_write only has to update the checksum before sending it
+ */
+struct SyncWritePacket {
+	std::vector<MotorID> motors;
+	int baseRegister {0};
+	std::size_t length {0};
+
+	// the data of motors[idx] inside of the packet
+	[[nodiscard]] auto data(std::size_t idx) -> std::byte* { return packet.data() + dataOffset + idx * (length + 1) + 1; }
+	void set(std::size_t idx, ByteSpan data) {
+		if (idx >= motors.size() or data.size() != length) {
+			throw std::runtime_error("SyncWritePacket: data does not fit into the packet");
+		}
+		std::memcpy(this->data(idx), data.data(), length);
+	}
+
+	Parameter packet;
+	std::size_t dataOffset {0}; // offset of the first [id, data...] entry inside of packet
+};
+
+/**
+ * a BULK_READ or SYNC_READ that is issued over and over again (e.g. by a control loop)
+ * the request packet and the buffers for the replies are built once by USB2Dynamixel::prepareBulkRead/prepareSyncRead,
+ * USB2Dynamixel::execute only sends the packet and copies the replies into the prepared buffers, hence it does not allocate.
+ */
+struct PreparedRead {
+	std::vector<std::tuple<MotorID, int, std::size_t>> motors; // [motorID, baseRegister, length]
+
+	// results of the last execution, idx refers to motors
+	[[nodiscard]] auto size() const -> std::size_t { return motors.size(); }
+	[[nodiscard]] auto getNumReplies() const -> std::size_t { return numReplies; }
+	[[nodiscard]] bool hasReplied(std::size_t idx) const { return replied[idx]; }
+	[[nodiscard]] auto getErrorCode(std::size_t idx) const -> ErrorCode { return errorCodes[idx]; }
+	[[nodiscard]] auto getData(std::size_t idx) const -> ByteSpan { return {data.data() + offsets[idx], std::get<2>(motors[idx])}; }
+
+	// copy the reply of motors[idx] into layout (e.g. a Layout<> of matching size), returns false if the motor did not reply
+	template <typename LayoutT>
+	bool get(std::size_t idx, LayoutT& layout) const {
+		static_assert(std::is_trivially_copyable_v<LayoutT>);
+		if (not replied[idx] or std::get<2>(motors[idx]) != sizeof(LayoutT)) {
+			return false;
+		}
+		std::memcpy(&layout, data.data() + offsets[idx], sizeof(LayoutT));
+		return true;
+	}
+
+	Instruction instruction {Instruction::BULK_READ};
+	Parameter packet;
+	std::size_t numRequestParameters {0};
+
+	std::vector<uint8_t> replied;
+	std::vector<ErrorCode> errorCodes;
+	std::vector<std::size_t> offsets; // offset of the reply of every motor in data
+	Parameter data;
+	std::size_t numReplies {0};
+};
+
 struct USB2Dynamixel {
 	using Timeout = std::chrono::microseconds;
 
+	// pass as timeout to let the timing model derive the deadline of a transaction (see estimateTimeout)
+	static constexpr Timeout AutoTimeout {-1};
+
 	USB2Dynamixel(int baudrate, std::string const& device, Protocol protocol = Protocol::V1);
 	~USB2Dynamixel();
 
 	[[nodiscard]] bool ping(MotorID motor, Timeout timeout) const;
+
+	/**
+	 * send a single PING to all motors (protocol v2 only), every present motor answers in turn
+	 * replies are collected until window has passed, returns [motorID, modelNumber] of all motors that answered
+	 */
+	[[nodiscard]] auto broadcast_ping(Timeout window) const -> std::vector<std::tuple<MotorID, uint16_t>>;
+
 	[[nodiscard]] auto read(MotorID motor, int baseRegister, size_t length, Timeout timeout) const -> std::tuple<bool, MotorID, ErrorCode, Parameter>;
-	[[nodiscard]] auto bulk_read(std::vector<std::tuple<MotorID, int, size_t>> const& motors, Timeout timeout) const -> std::vector<std::tuple<MotorID, int, ErrorCode, Parameter>>;
+	// same as read but the payload is copied straight to out (which needs room for length bytes), out is only written if the motor replied
+	auto read(MotorID motor, int baseRegister, std::byte* out, size_t length, Timeout timeout) const -> std::tuple<bool, MotorID, ErrorCode>;
+	/**
+	 * read from several motors with a single request, all replies are collected in one pass
+	 * the result holds one entry [timeoutFlag, motorID, baseRegister, errorCode, payload] per requested motor (in request order)
+	 * timeout is the time to wait for the next reply
+	 */
+	[[nodiscard]] auto bulk_read(std::vector<std::tuple<MotorID, int, size_t>> const& motors, Timeout timeout) const -> std::vector<std::tuple<bool, MotorID, int, ErrorCode, Parameter>>;
+
+	/**
+	 * read the same register window from several motors with a single SYNC_READ request (protocol v2 only)
+	 * the result holds one entry [timeoutFlag, motorID, errorCode, payload] per requested motor (in request order)
+	 * timeout is the time to wait for the next reply
+	 */
+	[[nodiscard]] auto sync_read(std::vector<MotorID> const& motors, int baseRegister, size_t length, Timeout timeout) const -> std::vector<std::tuple<bool, MotorID, ErrorCode, Parameter>>;
+
+	// build a bulk read / sync read once and run it with execute as often as needed
+	[[nodiscard]] auto prepareBulkRead(std::vector<std::tuple<MotorID, int, size_t>> const& motors) const -> PreparedRead;
+	[[nodiscard]] auto prepareSyncRead(std::vector<MotorID> const& motors, int baseRegister, size_t length) const -> PreparedRead;
+	/**
+	 * send a prepared read and collect the replies into it
+	 * timeout is the time to wait for the next reply, returns the number of motors that replied
+	 */
+	auto execute(PreparedRead& read, Timeout timeout) const -> std::size_t;
+	/**
+	 * same as execute but the reply of the motor read.motors[idx] is copied straight to layouts[idx]
+	 * every motor has to be read with a length of sizeof(LayoutT), layouts of motors that did not reply are left untouched
+	 */
+	template <typename LayoutT>
+	auto execute(PreparedRead& read, LayoutT* layouts, Timeout timeout) const -> std::size_t {
+		static_assert(std::is_trivially_copyable_v<LayoutT>);
+		return executeInto(read, reinterpret_cast<std::byte*>(layouts), sizeof(LayoutT), timeout);
+	}
+
+	// sync read is only available in protocol v2, otherwise bulk_read has to be used
+	[[nodiscard]] bool supportsSyncRead() const { return mProtocolVersion == Protocol::V2; }
+	[[nodiscard]] auto getProtocol() const -> Protocol { return mProtocolVersion; }
+	[[nodiscard]] auto getBaudrate() const -> int { return mBaudrate; }
+	// configure the port for baudrate (again) and drop pending input, e.g. after another port on the same device changed it
+	void setBaudrate(int baudrate);
+
+	// time it takes to send numBytes over the bus (one start and one stop bit per byte)
+	[[nodiscard]] auto getTransferTime(std::size_t numBytes) const -> std::chrono::nanoseconds {
+		return std::chrono::nanoseconds{int64_t(numBytes) * 10 * 1'000'000'000 / mBaudrate};
+	}
+
+	/**
+	 * timing model
+	 * a reply is expected after the request and the status packet went over the wire, the motor waited
+	 * its RETURN_DELAY_TIME and the usb adapter passed the bytes on (latency).
+	 * Motors with unknown return delay are assumed to use the longest possible one (508us).
+	 * estimateTimeout returns that time for a request with requestParameters and a reply with responseParameters bytes.
+	 */
+	[[nodiscard]] auto estimateTimeout(std::size_t requestParameters, std::size_t responseParameters, MotorID motor) const -> Timeout;
+	void setReturnDelay(MotorID motor, std::chrono::microseconds returnDelay);
+	[[nodiscard]] auto getReturnDelay(MotorID motor) const -> std::chrono::nanoseconds;
+	// read and remember the RETURN_DELAY_TIME of a motor, returns false if it did not answer
+	bool calibrateReturnDelay(MotorID motor, LayoutType layout, Timeout timeout);
+	void setLatency(std::chrono::microseconds latency);
+	[[nodiscard]] auto getLatency() const -> std::chrono::nanoseconds;
+	// refine the latency with every answered single motor request (moving average of the observed latency and its deviation)
+	// only replies of motors with a known return delay are used, an assumed 508us would hide the latency
+	void setLearnLatency(bool learn);
 
 	void write(MotorID motor, int baseRegister, Parameter const& txBuf) const;
 	auto writeRead(MotorID motor, int baseRegister, Parameter const& txBuf, Timeout timeout) const -> std::tuple<bool, MotorID, ErrorCode, Parameter>;
 
 	void sync_write(std::map<MotorID, Parameter> const& motorParams, int baseRegister) const;
+	// build a SYNC_WRITE packet that writes length bytes starting at baseRegister to every motor (the data is zero initially)
+	[[nodiscard]] auto prepareSyncWrite(std::vector<MotorID> const& motors, int baseRegister, std::size_t length) const -> SyncWritePacket;
+	// send a prepared packet, only its checksum has to be updated
+	void sync_write(SyncWritePacket& packet) const;
+
+	/**
+	 * write a different register window to each motor [motorID, baseRegister, data]
+	 * protocol v2 packs all writes into a single BULK_WRITE packet, protocol v1 falls back to one write per motor
+	 */
+	void bulk_write(std::vector<std::tuple<MotorID, int, Parameter>> const& motors) const;
+
+	/**
+	 * stage a write with REG_WRITE, the motor applies it when it receives an ACTION
+	 */
+	void reg_write(MotorID motor, int baseRegister, Parameter const& txBuf) const;
+	void action(MotorID motor = BroadcastID) const;
+
+	/**
+	 * stage a write for every motor [motorID, baseRegister, data] and apply all of them with a single broadcast ACTION
+	 * hence all motors start within one packet time no matter how long the writes took
+	 * returns the skew: the time from handing the first REG_WRITE to the kernel until the ACTION was transmitted
+	 * (the output is drained, so this includes the time on the wire; that is the skew a loop of plain writes
+	 * would have between the first and the last motor)
+	 */
+	auto staged_write(std::vector<std::tuple<MotorID, int, Parameter>> const& motors) const -> std::chrono::nanoseconds;
 
 	void reset(MotorID motor) const;
 	void reboot(MotorID motor)const;
 
+	struct ReceptionStats {
+		std::chrono::nanoseconds cpuTime  {0}; // cpu time the calling threads spent receiving packets
+		std::chrono::nanoseconds wallTime {0}; // wall clock time spent waiting for and receiving packets
+		int64_t numReceptions {0};
+	};
+	[[nodiscard]] auto getReceptionStats() const -> ReceptionStats;
+
 	template <auto baseRegister, size_t length>
 	[[nodiscard]] auto read(MotorID motor, Timeout timeout) -> std::tuple<bool, MotorID, ErrorCode, Layout<baseRegister, size_t(length)>> {
 		using RType = Layout<baseRegister, length>;
 		static_assert(length == sizeof(RType));
 
-		auto [timeoutFlag, motorID, errorCode, rxBuf] = read(motor, int(baseRegister), length, timeout);
-		if (timeoutFlag) {
-			return std::make_tuple(true, MotorIDInvalid, errorCode, RType{});
-		} else if (motorID == MotorIDInvalid) {
-			return std::make_tuple(false, MotorIDInvalid, errorCode, RType{});
+		RType layout{};
+		auto [timeoutFlag, motorID, errorCode] = read(motor, layout, timeout);
+		if (timeoutFlag or motorID == MotorIDInvalid) {
+			return std::make_tuple(timeoutFlag, MotorIDInvalid, errorCode, RType{});
 		}
-		return std::make_tuple(false, motorID, errorCode, RType(rxBuf));
+		return std::make_tuple(false, motorID, errorCode, layout);
+	}
+
+	// read straight into a caller provided layout, layout is only written if the motor replied
+	template <auto baseRegister, size_t length>
+	auto read(MotorID motor, Layout<baseRegister, length>& layout, Timeout timeout) const -> std::tuple<bool, MotorID, ErrorCode> {
+		static_assert(length == sizeof(layout) and std::is_trivially_copyable_v<Layout<baseRegister, length>>);
+		return read(motor, int(baseRegister), reinterpret_cast<std::byte*>(&layout), length, timeout);
 	}
 
 	template <auto baseRegister, size_t length, typename ...Extras>
@@ -61,19 +238,25 @@ struct USB2Dynamixel {
 		if (motors.empty()) return {};
 
 		std::vector<std::tuple<MotorID, int, size_t>> request;
-		for (auto data : motors) {
-			auto id = std::get<0>(data);
-			request.push_back(std::make_tuple(id, int(baseRegister), size_t(length)));
+		request.reserve(motors.size());
+		for (auto const& data : motors) {
+			request.emplace_back(std::get<0>(data), int(baseRegister), size_t(length));
 		}
-		auto list = bulk_read(request, timeout);
+		auto prepared = prepareBulkRead(request);
+		return collectLayouts<baseRegister, length>(prepared, motors, timeout);
+	}
 
-		std::vector<std::tuple<MotorID, Extras..., ErrorCode, Layout<baseRegister, length>>> response;
-		auto iter = begin(motors);
-		for (auto const& [id, _reg, errorCode, params] : list) {
-			response.push_back(std::tuple_cat(*iter, std::make_tuple(errorCode, Layout<baseRegister, length>{params})));
-			++iter;
+	template <auto baseRegister, size_t length, typename ...Extras>
+	[[nodiscard]] auto sync_read(std::vector<std::tuple<MotorID, Extras...>> const& motors, USB2Dynamixel::Timeout timeout) -> std::vector<std::tuple<MotorID, Extras..., ErrorCode, Layout<baseRegister, length>>> {
+		if (motors.empty()) return {};
+
+		std::vector<MotorID> request;
+		request.reserve(motors.size());
+		for (auto const& data : motors) {
+			request.push_back(std::get<0>(data));
 		}
-		return response;
+		auto prepared = prepareSyncRead(request, int(baseRegister), size_t(length));
+		return collectLayouts<baseRegister, length>(prepared, motors, timeout);
 	}
 
 	template <auto baseRegister, size_t length>
@@ -105,11 +288,94 @@ struct USB2Dynamixel {
 		sync_write(motorParams, int(baseRegister));
 	}
 
+	template <typename ...Layouts>
+	void bulk_write(std::tuple<MotorID, Layouts> const&... params) const {
+		std::vector<std::tuple<MotorID, int, Parameter>> motors;
+		auto add = [&](MotorID id, auto const& layout) {
+			std::vector<std::byte> txBuf(sizeof(layout));
+			memcpy(txBuf.data(), &layout, sizeof(layout));
+			motors.emplace_back(id, int(std::decay_t<decltype(layout)>::BaseRegister), std::move(txBuf));
+		};
+		(add(std::get<0>(params), std::get<1>(params)), ...);
+		bulk_write(motors);
+	}
+
+	template <typename ...Layouts>
+	auto staged_write(std::tuple<MotorID, Layouts> const&... params) const -> std::chrono::nanoseconds {
+		std::vector<std::tuple<MotorID, int, Parameter>> motors;
+		auto add = [&](MotorID id, auto const& layout) {
+			std::vector<std::byte> txBuf(sizeof(layout));
+			memcpy(txBuf.data(), &layout, sizeof(layout));
+			motors.emplace_back(id, int(std::decay_t<decltype(layout)>::BaseRegister), std::move(txBuf));
+		};
+		(add(std::get<0>(params), std::get<1>(params)), ...);
+		return staged_write(motors);
+	}
+
 private:
+	// execute a prepared read, replies are copied to destination + idx * stride or into read.data if destination is nullptr
+	auto executeInto(PreparedRead& read, std::byte* destination, std::size_t stride, Timeout timeout) const -> std::size_t;
+
+	// execute a prepared read and decode the replies into a response list, motors that did not reply are left out
+	template <auto baseRegister, size_t length, typename ...Extras>
+	auto collectLayouts(PreparedRead& prepared, std::vector<std::tuple<MotorID, Extras...>> const& motors, Timeout timeout) const -> std::vector<std::tuple<MotorID, Extras..., ErrorCode, Layout<baseRegister, length>>> {
+		std::vector<Layout<baseRegister, length>> layouts(motors.size());
+		execute(prepared, layouts.data(), timeout);
+
+		std::vector<std::tuple<MotorID, Extras..., ErrorCode, Layout<baseRegister, length>>> response;
+		response.reserve(prepared.getNumReplies());
+		for (std::size_t idx{0}; idx < motors.size(); ++idx) {
+			if (prepared.hasReplied(idx)) {
+				response.push_back(std::tuple_cat(motors[idx], std::make_tuple(prepared.getErrorCode(idx), layouts[idx])));
+			}
+		}
+		return response;
+	}
+
+	// send a request, replies to earlier requests that are still buffered are dropped. mMutex must be held
+	void transmit(Parameter const& packet) const;
+	// send a request whose parameters consist of several pieces with a single writev instead of copying them into a packet
+	void transmit(MotorID motor, Instruction instr, std::initializer_list<ByteSpan> parameters) const;
+
+	// replace AutoTimeout by the estimate of the timing model, mMutex must be held
+	auto resolveTimeout(Timeout timeout, std::size_t requestParameters, std::size_t responseParameters, MotorID motor) const -> Timeout;
+	// the latency margin of the timing model, mMutex must be held
+	auto latencyMargin() const -> std::chrono::nanoseconds;
+
+	// read a packet from the bus and keep track of the time spent doing so, mMutex must be held
+	// the payload points into mRxBuffer
+	auto receive(MotorID expectedMotorID, std::size_t numParameters, Timeout timeout) const -> std::tuple<bool, MotorID, ErrorCode, ByteSpan>;
+
+	// run a reception and add the time spent to mReceptionStats, mMutex must be held
+	template <typename Func>
+	auto measureReception(Func&& func) const {
+		auto startCPU  = simplyfile::getThreadTime();
+		auto startWall = std::chrono::high_resolution_clock::now();
+		auto result = func();
+		mReceptionStats.cpuTime  += simplyfile::getThreadTime() - startCPU;
+		mReceptionStats.wallTime += std::chrono::high_resolution_clock::now() - startWall;
+		mReceptionStats.numReceptions += 1;
+		return result;
+	}
+
+	Protocol mProtocolVersion;
+	int mBaudrate;
 	std::unique_ptr<ProtocolBase> mProtocol;
 	mutable std::mutex mMutex;
+	mutable ReceptionStats mReceptionStats;
 
 	simplyfile::SerialPort mPort;
+	mutable RxBuffer mRxBuffer;
+
+	// timing model
+	std::array<std::chrono::nanoseconds, 256> mReturnDelays;
+	std::bitset<256> mReturnDelayKnown;             // set by setReturnDelay, the others assume the longest delay
+	mutable std::chrono::nanoseconds mLatency {std::chrono::milliseconds{1}};
+	mutable std::chrono::nanoseconds mLatencyDeviation {0};
+	mutable bool mLatencySampled {false};
+	bool mLearnLatency {false};
+	mutable std::chrono::high_resolution_clock::time_point mLastTransmitTime;
+	mutable std::size_t mLastTransmitSize {0};
 };
 
 
@@ -0,0 +1,204 @@
+#include "WriteCoalescer.h"
+
+#include <algorithm>
+#include <exception>
+#include <iostream>
+#include <iterator>
+#include <tuple>
+#include <utility>
+
+namespace dynamixel {
+
+WriteCoalescer::WriteCoalescer(USB2Dynamixel const& usb2dyn, std::chrono::microseconds window, OnFlush onFlush)
+	: mUsb2dyn{usb2dyn}
+	, mWindow{window}
+	, mOnFlush{std::move(onFlush)}
+{
+	if (mWindow.count() > 0) {
+		mThread = std::thread([this]{ run(); });
+	}
+}
+
+WriteCoalescer::~WriteCoalescer() {
+	if (mThread.joinable()) {
+		{
+			auto g = std::lock_guard(mMutex);
+			mStop = true;
+		}
+		mCondition.notify_one();
+		mThread.join();
+	}
+	try {
+		flush();
+	} catch (std::exception const&) {}
+}
+
+void WriteCoalescer::write(MotorID motor, int reg, Parameter data) {
+	if (data.empty()) {
+		return;
+	}
+	{
+		auto g = std::lock_guard(mMutex);
+		++mStats.writes;
+		if (mPending.empty()) {
+			mDeadline = Clock::now() + mWindow;
+		}
+		// held writes never overlap: the bytes the new write covers are removed from older ones, send joins them in any order
+		auto& registers = mPending[motor];
+		auto end = reg + int(data.size());
+		auto iter = registers.lower_bound(reg);
+		if (iter != registers.begin() and std::prev(iter)->first + int(std::prev(iter)->second.size()) > reg) {
+			--iter;
+		}
+		while (iter != registers.end() and iter->first < end) {
+			auto older    = std::move(iter->second);
+			auto olderReg = iter->first;
+			iter = registers.erase(iter);
+			if (olderReg < reg) {
+				registers.emplace(olderReg, Parameter(older.begin(), older.begin() + (reg - olderReg)));
+			}
+			if (olderReg + int(older.size()) > end) {
+				registers.emplace(end, Parameter(older.begin() + (end - olderReg), older.end()));
+				break;
+			}
+		}
+		registers[reg] = std::move(data);
+	}
+	if (mWindow.count() == 0) {
+		flush();
+		return;
+	}
+	mCondition.notify_one();
+}
+
+auto WriteCoalescer::flush() -> std::size_t {
+	auto sendGuard = std::lock_guard(mSendMutex);
+	Writes writes;
+	{
+		auto g = std::lock_guard(mMutex);
+		std::swap(writes, mPending);
+	}
+	if (writes.empty()) {
+		return 0;
+	}
+	auto onFlush = [&] {
+		if (mOnFlush) {
+			std::vector<MotorID> motors;
+			for (auto const& [motor, registers] : writes) {
+				motors.push_back(motor);
+			}
+			mOnFlush(motors);
+		}
+	};
+	std::size_t packets;
+	try {
+		packets = send(writes);
+	} catch (...) {
+		{
+			auto g = std::lock_guard(mMutex);
+			++mStats.failedFlushes;
+		}
+		// some of the packets may have been sent before the failure
+		onFlush();
+		throw;
+	}
+	{
+		auto g = std::lock_guard(mMutex);
+		++mStats.flushes;
+		mStats.packets += packets;
+	}
+	onFlush();
+	return packets;
+}
+
+auto WriteCoalescer::takeFailure() -> bool {
+	auto g = std::lock_guard(mMutex);
+	return std::exchange(mFailed, false);
+}
+
+auto WriteCoalescer::getStats() const -> Stats {
+	auto g = std::lock_guard(mMutex);
+	return mStats;
+}
+
+void WriteCoalescer::run() {
+	auto lock = std::unique_lock(mMutex);
+	while (not mStop) {
+		if (mPending.empty()) {
+			mCondition.wait(lock);
+			continue;
+		}
+		if (Clock::now() < mDeadline) {
+			mCondition.wait_until(lock, mDeadline);
+			continue;
+		}
+		lock.unlock();
+		bool failed {false};
+		try {
+			flush();
+		} catch (std::exception const& e) {
+			std::cerr << "sending held writes failed: " << e.what() << "\n";
+			failed = true;
+		}
+		lock.lock();
+		mFailed = mFailed or failed;
+	}
+}
+
+auto WriteCoalescer::send(Writes const& writes) -> std::size_t {
+	// join adjacent (or overlapping) registers of every motor into windows [baseRegister, data]
+	std::map<MotorID, std::vector<std::tuple<int, Parameter>>> windows;
+	for (auto const& [motor, registers] : writes) {
+		auto& motorWindows = windows[motor];
+		for (auto const& [reg, data] : registers) {
+			if (not motorWindows.empty()) {
+				auto& [baseRegister, bytes] = motorWindows.back();
+				if (reg <= baseRegister + int(bytes.size())) {
+					auto offset = std::size_t(reg - baseRegister);
+					bytes.resize(std::max(bytes.size(), offset + data.size()));
+					std::copy(data.begin(), data.end(), bytes.begin() + offset);
+					continue;
+				}
+			}
+			motorWindows.emplace_back(reg, data);
+		}
+	}
+
+	// motors that get the same window [baseRegister, length]
+	std::map<std::tuple<int, std::size_t>, std::map<MotorID, Parameter>> groups;
+	for (auto const& [motor, motorWindows] : windows) {
+		for (auto const& [baseRegister, bytes] : motorWindows) {
+			groups[{baseRegister, bytes.size()}][motor] = bytes;
+		}
+	}
+
+	// a bulk write addresses every motor only once, a motor with several windows needs several of them
+	std::size_t rounds {0};
+	for (auto const& [motor, motorWindows] : windows) {
+		rounds = std::max(rounds, motorWindows.size());
+	}
+	if (mUsb2dyn.getProtocol() == Protocol::V1 or groups.size() <= rounds) {
+		for (auto const& [window, motorParams] : groups) {
+			auto baseRegister = std::get<0>(window);
+			if (motorParams.size() == 1) {
+				mUsb2dyn.write(motorParams.begin()->first, baseRegister, motorParams.begin()->second);
+			} else {
+				mUsb2dyn.sync_write(motorParams, baseRegister);
+			}
+		}
+		return groups.size();
+	}
+
+	for (std::size_t round{0}; round < rounds; ++round) {
+		std::vector<std::tuple<MotorID, int, Parameter>> bulk;
+		for (auto const& [motor, motorWindows] : windows) {
+			if (round < motorWindows.size()) {
+				bulk.emplace_back(motor, std::get<0>(motorWindows[round]), std::get<1>(motorWindows[round]));
+			}
+		}
+		mUsb2dyn.bulk_write(bulk);
+	}
+	return rounds;
+}
+
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "USB2Dynamixel.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dynamixel {
+
+/**
+ * collects register writes and sends them with as few packets as possible
+ *
+ * writes are held until window has passed since the first of them (or until flush is called) and are then sent together:
+ * a register written on several motors becomes one sync write, writes of different registers become one sync write
+ * per register or, if that takes fewer packets, bulk writes (protocol v2 only, a bulk write addresses every motor once).
+ * Writes to adjacent registers of a motor are joined, a register that is written twice (also by overlapping writes)
+ * keeps the last value.
+ * Motors that receive their writes with the same packet act at the same time.
+ * A window of zero sends every write right away, a negative window holds the writes until flush is called.
+ */
+struct WriteCoalescer {
+	using Clock   = std::chrono::steady_clock;
+	// called with the written motors after every flush (e.g. to invalidate cached registers)
+	using OnFlush = std::function<void(std::vector<MotorID> const&)>;
+
+	WriteCoalescer(USB2Dynamixel const& usb2dyn, std::chrono::microseconds window, OnFlush onFlush = {});
+	// sends the writes that are still held
+	~WriteCoalescer();
+
+	void write(MotorID motor, int reg, Parameter data);
+	// send all held writes now, returns the number of packets
+	// throws if sending failed, the held writes are dropped either way
+	auto flush() -> std::size_t;
+	// true if a flush of the window thread failed since the last call
+	[[nodiscard]] auto takeFailure() -> bool;
+
+	[[nodiscard]] auto getWindow() const -> std::chrono::microseconds { return mWindow; }
+
+	struct Stats {
+		int64_t writes {0};  // calls of write
+		int64_t flushes {0}; // flushes that sent something
+		int64_t packets {0}; // packets of all flushes
+		int64_t failedFlushes {0}; // flushes that threw while sending, their writes are lost
+	};
+	[[nodiscard]] auto getStats() const -> Stats;
+
+private:
+	using Writes = std::map<MotorID, std::map<int, Parameter>>; // data by register of every motor
+
+	void run();
+	auto send(Writes const& writes) -> std::size_t;
+
+	USB2Dynamixel const& mUsb2dyn;
+	std::chrono::microseconds mWindow;
+	OnFlush mOnFlush;
+
+	std::mutex mSendMutex;            // flushes are sent in order
+	mutable std::mutex mMutex;
+	std::condition_variable mCondition;
+	Writes mPending;
+	Clock::time_point mDeadline;      // when the pending writes are flushed
+	bool mStop {false};
+	bool mFailed {false};             // a flush of mThread failed, reported by takeFailure
+	Stats mStats;
+	std::thread mThread;              // flushes when the window has passed, only runs for a positive window
+};
+
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <functional>
 #include <stdexcept>
@@ -14,6 +15,19 @@ namespace dynamixel {
 
 	using Parameter = std::vector<std::byte>;
 
+	// non owning view onto a contiguous range of bytes (e.g. the payload of a packet inside of a receive buffer)
+	struct ByteSpan {
+		std::byte const* ptr {nullptr};
+		std::size_t      len {0};
+
+		[[nodiscard]] auto data()  const -> std::byte const* { return ptr; }
+		[[nodiscard]] auto size()  const -> std::size_t { return len; }
+		[[nodiscard]] bool empty() const { return len == 0; }
+		[[nodiscard]] auto begin() const -> std::byte const* { return ptr; }
+		[[nodiscard]] auto end()   const -> std::byte const* { return ptr + len; }
+		[[nodiscard]] auto operator[](std::size_t idx) const -> std::byte { return ptr[idx]; }
+	};
+
 	enum class Instruction : std::underlying_type_t<std::byte>
 	{
 		PING       = 0x01,
@@ -7,7 +7,9 @@
 #include <stdexcept>
 #include <string>
 
+#include <poll.h>
 #include <sys/types.h>
+#include <termios.h>
 #include <unistd.h>
 
 
@@ -15,11 +17,15 @@ namespace dynamixel::file_io {
 
 auto read(int _fd, size_t maxReadBytes) -> std::vector<std::byte> {
 	std::vector<std::byte> rxBuf(maxReadBytes);
+	rxBuf.resize(read(_fd, rxBuf.data(), rxBuf.size()));
+	return rxBuf;
+}
 
+auto read(int _fd, std::byte* buffer, size_t maxReadBytes) -> size_t {
 	size_t bytesRead = 0;
 
 	do {
-		ssize_t r = ::read(_fd, rxBuf.data() + bytesRead, rxBuf.size() - bytesRead);
+		ssize_t r = ::read(_fd, buffer + bytesRead, maxReadBytes - bytesRead);
 		if (r == -1) {
 			if (errno == EAGAIN) {
 				break;
@@ -30,8 +36,7 @@ auto read(int _fd, size_t maxReadBytes) -> std::vector<std::byte> {
 		}
 		bytesRead += r;
 	} while (bytesRead < maxReadBytes);
-	rxBuf.resize(bytesRead);
-	return rxBuf;
+	return bytesRead;
 }
 
 size_t flushRead(int _fd) {
@@ -57,4 +62,53 @@ void write(int _fd, std::vector<std::byte> const& txBuf) {
 		bytesWritten += w;
 	} while (bytesWritten < count);
 }
+
+void write(int _fd, struct iovec* iov, int iovcnt) {
+	while (iovcnt > 0) {
+		ssize_t w = ::writev(_fd, iov, iovcnt);
+		if (w == -1) {
+			throw std::runtime_error(std::string{"write to the dyanmixel bus failed: "} + strerror(errno) + " (" + std::to_string(errno) + ")");
+		}
+		// skip everything that was written, the rest is written by the next call
+		while (iovcnt > 0 and std::size_t(w) >= iov->iov_len) {
+			w -= iov->iov_len;
+			++iov;
+			--iovcnt;
+		}
+		if (iovcnt > 0) {
+			iov->iov_base = static_cast<std::byte*>(iov->iov_base) + w;
+			iov->iov_len -= w;
+		}
+	}
+}
+
+void drain(int _fd) {
+	while (::tcdrain(_fd) == -1) {
+		if (errno != EINTR) {
+			throw std::runtime_error(std::string{"draining the dyanmixel bus failed: "} + strerror(errno) + " (" + std::to_string(errno) + ")");
+		}
+	}
+}
+
+bool waitForData(int _fd, std::chrono::nanoseconds timeout) {
+	struct pollfd pfd {_fd, POLLIN, 0};
+	struct timespec ts {};
+	struct timespec* tsPtr {nullptr};
+	if (timeout.count() >= 0) {
+		auto seconds = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+		ts.tv_sec  = seconds.count();
+		ts.tv_nsec = (timeout - seconds).count();
+		tsPtr = &ts;
+	}
+	while (true) {
+		int r = ::ppoll(&pfd, 1, tsPtr, nullptr);
+		if (r == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			throw std::runtime_error(std::string{"unexpected poll error: "} + strerror(errno) + " (" + std::to_string(errno) + ")");
+		}
+		return r > 0;
+	}
+}
 }
@@ -1,10 +1,26 @@
 #pragma once
 
+#include <chrono>
 #include <vector>
 #include <cstddef>
 
+#include <sys/uio.h>
+
 namespace dynamixel::file_io {
 auto read(int _fd, size_t maxReadBytes) -> std::vector<std::byte>;
+// read up to maxReadBytes into buffer without blocking, returns the number of bytes read
+auto read(int _fd, std::byte* buffer, size_t maxReadBytes) -> size_t;
 size_t flushRead(int _fd);
 void write(int _fd, std::vector<std::byte> const& txBuf);
-}
\ No newline at end of file
+// gather write of iovcnt buffers with as few syscalls as possible, iov is modified if a write was partial
+void write(int _fd, struct iovec* iov, int iovcnt);
+// block until everything written to _fd has been transmitted
+void drain(int _fd);
+
+/**
+ * block until _fd has data to read or the timeout expired
+ * a negative timeout blocks indefinitely
+ * returns false if the timeout expired
+ */
+bool waitForData(int _fd, std::chrono::nanoseconds timeout);
+}